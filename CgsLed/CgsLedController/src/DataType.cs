@@ -3,5 +3,11 @@
 public enum DataType : byte {
     Power,
     Data,
-    Ping
+    Ping,
+    Spans,
+    Compressed,
+    Credits,
+    Effect = 7,
+    Interpolate = 8,
+    Timed = 9
 }
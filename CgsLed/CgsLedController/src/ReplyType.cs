@@ -0,0 +1,7 @@
+﻿namespace CgsLedController;
+
+public enum ReplyType : byte {
+    Pong = 0,
+    Ready = 1,
+    Credits = 0x40
+}
@@ -6,7 +6,15 @@ public class SerialPortLedWriter : LedWriter {
     public override bool isOpen => _port.IsOpen;
 
     private readonly SerialPort _port;
-    private bool _canContinue = true;
+
+    // a pong that didn't come back by then isn't coming, its credit goes back like in the openrgb plugin
+    private const int PongTimeoutMs = 1000;
+
+    // every ping in flight holds one of the device's credits until its pong comes back
+    private int _credits = 1;
+    private int _inFlight;
+    private bool _askedCredits;
+    private ReplyType _replyType = ReplyType.Pong;
 
     // SerialPort API is stupid and doesn't let me write a span....
     private readonly byte[] _bytes = new byte[1024];
@@ -15,6 +23,7 @@ public class SerialPortLedWriter : LedWriter {
 
     public void Open() {
         _port.DtrEnable = true;
+        _port.ReadTimeout = PongTimeoutMs;
         _port.Open();
         // wait for arduino to reset
         //bool canContinue = false;
@@ -32,15 +41,40 @@ public class SerialPortLedWriter : LedWriter {
     }
 
     public override void Ping(LedBuffer buffer) {
+        // devices that don't know about credits ignore the question and we stay at one frame in flight
+        if(!_askedCredits) {
+            buffer.Write((byte)DataType.Credits);
+            _askedCredits = true;
+        }
         buffer.Write((byte)DataType.Ping);
-        while(_port.BytesToWrite > 0) { }
-        while(!_canContinue) {
-            while(_port.BytesToRead > 0) {
-                if(_port.ReadByte() == 0)
-                    _canContinue = true;
+        ReadReplies();
+        // sleeps in the read until a reply comes instead of spinning on BytesToRead
+        while(_inFlight >= _credits) {
+            try {
+                HandleReply(_port.ReadByte());
+            }
+            catch(TimeoutException) {
+                _inFlight--;
             }
         }
-        _canContinue = false;
+        _inFlight++;
+    }
+
+    private void ReadReplies() {
+        while(_port.BytesToRead > 0)
+            HandleReply(_port.ReadByte());
+    }
+
+    private void HandleReply(int x) {
+        // payload bytes have the high bit set
+        if((x & 0x80) != 0) {
+            if(_replyType == ReplyType.Credits)
+                _credits = Math.Max(x & 0x7f, 1);
+            return;
+        }
+        _replyType = (ReplyType)x;
+        if(_replyType == ReplyType.Pong && _inFlight > 0)
+            _inFlight--;
     }
 
     public override void Write(LedBuffer.LedData[] data, int count, float brightness) {
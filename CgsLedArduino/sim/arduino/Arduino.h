@@ -0,0 +1,10 @@
+#pragma once
+
+// just enough of the core for led.hpp's compile time parts on the host, see kernels.cpp and ledsim.cpp
+#include <cstddef>
+#include <cstdint>
+
+#define F_CPU 16000000ul
+#define OUTPUT 1
+
+void pinMode(uint8_t pin, uint8_t mode);
@@ -0,0 +1,22 @@
+# runs the firmware that was just built in simavr through sim's ctest, see ledsim.cpp. only the check env in
+# ../platformio.ini has this, a firmware that doesn't pass fails that build
+import os
+import subprocess
+
+Import("env")
+
+
+def check(source, target, env):
+    sim_dir = os.path.join(env.subst("$PROJECT_DIR"), "sim")
+    build_dir = os.path.join(env.subst("$BUILD_DIR"), "sim")
+    os.makedirs(build_dir, exist_ok=True)
+    for command in (["cmake", "-S", sim_dir, "-B", build_dir, "-DCMAKE_BUILD_TYPE=Release",
+                     "-DFIRMWARE_ELF=" + target[0].get_abspath()],
+                    ["cmake", "--build", build_dir, "--config", "Release"],
+                    ["ctest", "-C", "Release", "--output-on-failure", "--no-tests=error"]):
+        if subprocess.call(command, cwd=build_dir) != 0:
+            return 1
+    return 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check)
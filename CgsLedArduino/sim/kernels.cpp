@@ -0,0 +1,297 @@
+#include "led.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// runs the sendRaw kernels' asm straight out of led.hpp, the same text avr-gcc gets, with the avr's cycle counts
+// and sends random bytes through them. every bit has to decode back to what was sent, the highs and lows have to be
+// exactly what kernelTiming works out from kernelOps and nothing but the strips' pins may change. no avr toolchain
+// needed, so it can't say what the compiler puts around the kernels, that's ledsim's part
+
+namespace {
+    int failures = 0;
+
+    void fail(const std::string& what) {
+        printf("failed: %s\n", what.c_str());
+        failures++;
+    }
+
+    uint32_t seed = 1;
+    uint8_t next() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<uint8_t>(seed >> 24);
+    }
+
+    std::string trim(const std::string& x) {
+        size_t start = x.find_first_not_of(" \t");
+        if (start == std::string::npos)
+            return "";
+        return x.substr(start, x.find_last_not_of(" \t") - start + 1);
+    }
+
+    // the asm of every sendRaw in led.hpp, one instruction per line as written
+    std::vector<std::vector<std::string>> readKernels(const char* path) {
+        std::ifstream file(path);
+        std::vector<std::vector<std::string>> res;
+        std::string line;
+        bool inSendRaw = false;
+        bool inAsm = false;
+        while (std::getline(file, line)) {
+            std::string text = trim(line);
+            if (text.find("static inline void sendRaw(") != std::string::npos) {
+                inSendRaw = true;
+                continue;
+            }
+            if (inSendRaw && text == "asm volatile") {
+                res.emplace_back();
+                inAsm = true;
+                continue;
+            }
+            if (!inAsm)
+                continue;
+            if (text.rfind(':', 0) == 0) {
+                inSendRaw = false;
+                inAsm = false;
+                continue;
+            }
+            size_t open = text.find('"');
+            if (open == std::string::npos)
+                continue;
+            std::string insn = text.substr(open + 1, text.find('"', open + 1) - open - 1);
+            size_t escape = insn.find('\\');
+            res.back().push_back(trim(escape == std::string::npos ? insn : insn.substr(0, escape)));
+        }
+        return res;
+    }
+
+    struct Kernel {
+        size_t lanes = 0;
+        std::vector<std::string> ops;
+        std::vector<std::vector<std::string>> args;
+        // where each numbered label is, for the 1b's
+        std::map<std::string, std::vector<size_t>> labels;
+    };
+
+    // .rept expanded and the operands of one set of pins filled in
+    Kernel assemble(const std::vector<std::string>& lines, const uint8_t* pins) {
+        Kernel res;
+        std::vector<std::string> expanded;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (lines[i].rfind(".rept", 0) != 0) {
+                expanded.push_back(lines[i]);
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < lines.size() && lines[end] != ".endr")
+                end++;
+            for (int n = std::atoi(lines[i].c_str() + 5); n > 0; n--)
+                expanded.insert(expanded.end(), lines.begin() + i + 1, lines.begin() + end);
+            i = end;
+        }
+        for (std::string line : expanded) {
+            for (size_t lane = 0; lane < maxLanes; lane++) {
+                std::string n = std::to_string(lane);
+                const std::pair<std::string, int> operands[] = {
+                    { "%[DATA_" + n + "]", static_cast<int>(16 + lane) },
+                    { "%[PORT_" + n + "]", pinPort(pins[lane]) },
+                    { "%[BIT_" + n + "]", pinBit(pins[lane]) }
+                };
+                for (const auto& [name, value] : operands) {
+                    for (size_t at; (at = line.find(name)) != std::string::npos;) {
+                        line.replace(at, name.size(), std::to_string(value));
+                        if (name[2] == 'D')
+                            res.lanes = std::max(res.lanes, lane + 1);
+                    }
+                }
+            }
+            if (line.back() == ':') {
+                res.labels[line.substr(0, line.size() - 1)].push_back(res.ops.size());
+                continue;
+            }
+            std::istringstream stream(line);
+            std::string op;
+            stream >> op;
+            std::vector<std::string> args;
+            for (std::string arg; std::getline(stream, arg, ',');)
+                args.push_back(trim(arg));
+            res.ops.push_back(op);
+            res.args.push_back(args);
+        }
+        return res;
+    }
+
+    struct Avr {
+        uint8_t regs[32] = { };
+        uint8_t io[64] = { };
+        uint64_t cycle = 0;
+        // a pin's level and when it got there, sbi/cbi change it in their last cycle
+        std::map<std::pair<int, int>, std::vector<std::pair<uint64_t, bool>>> edges;
+        bool foreign = false;
+
+        int reg(const std::string& x) { return std::atoi(x.c_str() + (x[0] == 'r' ? 1 : 0)); }
+
+        void setBit(const std::vector<std::string>& args, bool high) {
+            int port = std::atoi(args[0].c_str());
+            int bit = std::atoi(args[1].c_str());
+            cycle += 2;
+            bool was = (io[port] >> bit) & 1;
+            io[port] = high ? io[port] | (1 << bit) : io[port] & ~(1 << bit);
+            auto pin = edges.find({ port, bit });
+            if (pin == edges.end())
+                foreign = true;
+            else if (was != high)
+                pin->second.push_back({ cycle, high });
+        }
+
+        // false on anything the kernels aren't supposed to have
+        bool run(const Kernel& kernel) {
+            for (size_t pc = 0; pc < kernel.ops.size(); pc++) {
+                const std::string& op = kernel.ops[pc];
+                const auto& args = kernel.args[pc];
+                if (op == "SBI" || op == "CBI") {
+                    setBit(args, op == "SBI");
+                }
+                else if (op == "NOP") {
+                    cycle++;
+                }
+                else if (op == "SBRS") {
+                    // every instruction in there is one word
+                    bool skip = (regs[reg(args[0])] >> std::atoi(args[1].c_str())) & 1;
+                    cycle += skip ? 2 : 1;
+                    pc += skip;
+                }
+                else if (op == "LSL") {
+                    regs[reg(args[0])] <<= 1;
+                    cycle++;
+                }
+                else if (op == "LDI") {
+                    regs[reg(args[0])] = static_cast<uint8_t>(std::atoi(args[1].c_str()));
+                    cycle++;
+                }
+                else if (op == "DEC") {
+                    regs[reg(args[0])]--;
+                    cycle++;
+                }
+                else if (op == "BRNE") {
+                    // only ever a numbered label backwards
+                    bool taken = regs[20] != 0;
+                    cycle += taken ? 2 : 1;
+                    if (taken) {
+                        const auto& at = kernel.labels.at(args[0].substr(0, args[0].size() - 1));
+                        pc = *std::prev(std::upper_bound(at.begin(), at.end(), pc)) - 1;
+                    }
+                }
+                else {
+                    printf("don't know %s\n", op.c_str());
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    void check(const std::vector<std::string>& lines, const uint8_t* pins, size_t bytes, bool print) {
+        Kernel kernel = assemble(lines, pins);
+        const size_t lanes = kernel.lanes;
+        std::string name = std::to_string(lanes) + " lane" + (lanes > 1 ? "s" : "") + " on pins";
+        for (size_t lane = 0; lane < lanes; lane++)
+            name += " " + std::to_string(pins[lane]);
+
+        Avr avr;
+        // the other pins of the ports have to keep whatever they had
+        for (auto& x : avr.io)
+            x = 0x5a;
+        for (size_t lane = 0; lane < lanes; lane++)
+            avr.io[pinPort(pins[lane])] &= ~(1 << pinBit(pins[lane]));
+        for (size_t lane = 0; lane < lanes; lane++)
+            avr.edges[{ pinPort(pins[lane]), pinBit(pins[lane]) }];
+        uint8_t others[64];
+        std::copy(std::begin(avr.io), std::end(avr.io), others);
+
+        std::vector<std::vector<uint8_t>> sent(lanes);
+        for (size_t i = 0; i < bytes; i++) {
+            for (size_t lane = 0; lane < lanes; lane++) {
+                sent[lane].push_back(next());
+                avr.regs[16 + lane] = sent[lane].back();
+            }
+            if (!avr.run(kernel)) {
+                fail(name + " has something the kernels shouldn't");
+                return;
+            }
+        }
+        if (avr.foreign)
+            fail(name + " touched a pin that isn't a strip's");
+        for (size_t lane = 0; lane < lanes; lane++)
+            others[pinPort(pins[lane])] |= avr.io[pinPort(pins[lane])] & (1 << pinBit(pins[lane]));
+        if (!std::equal(std::begin(others), std::end(others), std::begin(avr.io)))
+            fail(name + " changed some other pin of a port");
+
+        led_timing measured { };
+        size_t wrong = 0;
+        for (size_t lane = 0; lane < lanes; lane++) {
+            const auto& edges = avr.edges[{ pinPort(pins[lane]), pinBit(pins[lane]) }];
+            if (edges.size() != bytes * 16) {
+                fail(name + " lane " + std::to_string(lane) + " didn't get a high for every bit");
+                return;
+            }
+            for (size_t i = 0; i < bytes * 8; i++) {
+                uint64_t high = edges[i * 2 + 1].first - edges[i * 2].first;
+                bool one = cyclesToNs(high) > (ws2812T0hMaxNs + ws2812T1hMinNs) / 2;
+                wrong += one != ((sent[lane][i / 8] >> (7 - i % 8)) & 1);
+                size_t& highMin = one ? measured.t1hMin : measured.t0hMin;
+                size_t& highMax = one ? measured.t1hMax : measured.t0hMax;
+                highMin = std::min<size_t>(highMin, high);
+                highMax = std::max<size_t>(highMax, high);
+                if (i + 1 < bytes * 8) {
+                    size_t low = edges[i * 2 + 2].first - edges[i * 2 + 1].first;
+                    measured.lowMin = std::min(measured.lowMin, low);
+                    measured.lowMax = std::max(measured.lowMax, low);
+                    if (lane == 0)
+                        measured.period = std::max<size_t>(measured.period, edges[i * 2 + 2].first - edges[i * 2].first);
+                }
+            }
+        }
+        if (wrong > 0)
+            fail(name + " sent " + std::to_string(wrong) + " bits wrong");
+
+        led_timing model = kernelTiming(lanes);
+        if (measured.t0hMin != model.t0hMin || measured.t0hMax != model.t0hMax ||
+            measured.t1hMin != model.t1hMin || measured.t1hMax != model.t1hMax ||
+            measured.lowMin != model.lowMin || measured.lowMax != model.lowMax || measured.period != model.period)
+            fail(name + " isn't what kernelOps says");
+        if (print || failures > 0) {
+            printf("%s: t0h %zu-%zu t1h %zu-%zu low %zu-%zu period %zu cycles, kernelOps t0h %zu-%zu t1h %zu-%zu "
+                "low %zu-%zu period %zu\n", name.c_str(), measured.t0hMin, measured.t0hMax, measured.t1hMin,
+                measured.t1hMax, measured.lowMin, measured.lowMax, measured.period, model.t0hMin, model.t0hMax,
+                model.t1hMin, model.t1hMax, model.lowMin, model.lowMax, model.period);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t bytes = argc > 2 ? strtoul(argv[2], nullptr, 10) : 0;
+    if (bytes == 0) {
+        fprintf(stderr, "usage: %s led.hpp bytes\n", argv[0]);
+        return 2;
+    }
+    auto kernels = readKernels(argv[1]);
+    if (kernels.size() != maxLanes) {
+        printf("failed: expected a sendRaw for each of 1-%zu lanes in %s, found %zu\n", maxLanes, argv[1], kernels.size());
+        return 1;
+    }
+
+    // neighbours on one port, every lane on its own port, and the same bit on different ports
+    const uint8_t layouts[][maxLanes] = { { 2, 3, 4 }, { 4, 9, 15 }, { 3, 11, 17 }, { 13, 12, 14 } };
+    for (const auto& lines : kernels) {
+        for (size_t i = 0; i < std::size(layouts); i++)
+            check(lines, layouts[i], bytes, i == 0);
+    }
+
+    printf("%s\n", failures == 0 ? "all good" : "failed");
+    return failures == 0 ? 0 : 1;
+}
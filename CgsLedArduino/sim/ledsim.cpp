@@ -0,0 +1,597 @@
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include "led.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+// runs the built firmware in simavr and talks to it over the uart like the plugin does, at the full 2mbaud and
+// raw and framed, then checks every edge the strips got against the ws2812b datasheet and decodes them back into
+// colors. fails on anything out of spec, a frame that doesn't show what was sent, a byte the avr's uart would have
+// dropped, a rejected frame, a pong that's slow to come back or a gap between leds longer than led.hpp allows for
+// when it picks how many lanes go out at once. the strips, their order and how many bits a frame can have are all
+// worked out from what comes out of the pins, so main.cpp's settings can change freely
+
+namespace {
+    constexpr uint32_t frequency = 16000000;
+    constexpr double nsPerCycle = 1e9 / frequency;
+    // 2mbaud with a start and a stop bit
+    constexpr avr_cycle_count_t cyclesPerByte = 80;
+
+    // the same windows led.hpp checks its model against
+    constexpr double t0hMinNs = 250;
+    constexpr double t0hMaxNs = 550;
+    constexpr double t1hMinNs = 650;
+    constexpr double t1hMaxNs = 950;
+    constexpr double lowMinNs = 300;
+    constexpr double lowMaxNs = 5000;
+    // anything in between is a 0 that's too long or a 1 that's too short
+    constexpr double oneNs = (t0hMaxNs + t1hMinNs) / 2;
+    // the datasheet's reset, a low that long only ever happens between frames
+    constexpr double resetNs = 50000;
+
+    // past what the strips take to show, the plugin gives up after a second but this is about the nano getting stuck
+    constexpr double pongSlackUs = 2000;
+
+    // USART_RX_vect is vector 18 on the atmega328p, 4 bytes each
+    constexpr avr_flashaddr_t rxVector = 18 * 4;
+    constexpr uint16_t retiOpcode = 0x9518;
+
+    enum : uint8_t { Power = 0, Data = 1, Ping = 2, Spans = 3, Indexed = 6, Framed = 0xa5 };
+    enum : uint8_t { Pong = 0, Ready = 1, Errors = 0x41, Lost = 0x44 };
+
+    avr_t* avr = nullptr;
+    avr_irq_t* uartIn = nullptr;
+    int failures = 0;
+
+    void fail(const char* what) {
+        printf("failed: %s\n", what);
+        failures++;
+    }
+
+    struct Pin {
+        bool high = false;
+        std::vector<std::pair<avr_cycle_count_t, bool>> edges;
+    };
+    // arduino numbering, 0-7 PORTD, 8-13 PORTB, 14-19 PORTC
+    Pin pins[20];
+
+    void onPin(avr_irq_t*, uint32_t value, void* param) {
+        Pin& pin = *static_cast<Pin*>(param);
+        bool high = value != 0;
+        if (high == pin.high)
+            return;
+        pin.high = high;
+        pin.edges.push_back({ avr->cycle, high });
+    }
+
+    std::vector<std::pair<avr_cycle_count_t, uint8_t>> replies;
+
+    void onReply(avr_irq_t*, uint32_t value, void*) {
+        replies.push_back({ avr->cycle, static_cast<uint8_t>(value) });
+    }
+
+    // the host side of the uart, a byte every 80 cycles whenever there's something to send
+    std::deque<uint8_t> toSend;
+    size_t sent = 0;
+    avr_cycle_count_t lastSent = 0;
+    // every entry into the rx interrupt takes one byte out of the uart
+    size_t received = 0;
+    size_t overruns = 0;
+
+    avr_cycle_count_t feed(avr_t*, avr_cycle_count_t when, void*) {
+        if (!toSend.empty()) {
+            // the byte before this one just came in. the avr holds two it hasn't read yet, a third one is lost
+            if (sent > 0 && sent - 1 >= received + 2)
+                overruns++;
+            avr_raise_irq(uartIn, toSend.front());
+            toSend.pop_front();
+            sent++;
+            lastSent = when;
+        }
+        return when + cyclesPerByte;
+    }
+
+    bool inRx = false;
+    avr_cycle_count_t rxStart = 0;
+    avr_cycle_count_t rxLongest = 0;
+
+    bool step() {
+        if (avr->pc == rxVector) {
+            inRx = true;
+            rxStart = avr->cycle;
+            received++;
+        }
+        bool leaving = inRx && (avr->flash[avr->pc] | (avr->flash[avr->pc + 1] << 8)) == retiOpcode;
+        int state = avr_run(avr);
+        if (leaving) {
+            inRx = false;
+            rxLongest = std::max(rxLongest, avr->cycle - rxStart);
+        }
+        return state != cpu_Done && state != cpu_Crashed;
+    }
+
+    avr_cycle_count_t usToCycles(double us) {
+        return static_cast<avr_cycle_count_t>(us * frequency / 1e6);
+    }
+
+    double cyclesToUs(avr_cycle_count_t cycles) {
+        return static_cast<double>(cycles) * 1e6 / frequency;
+    }
+
+    // false if the firmware stopped or it took longer than that
+    template <typename Done>
+    bool run(Done done, double us) {
+        avr_cycle_count_t end = avr->cycle + usToCycles(us);
+        while (!done()) {
+            if (avr->cycle >= end || !step())
+                return false;
+        }
+        return true;
+    }
+
+    void send(const std::vector<uint8_t>& message) {
+        toSend.insert(toSend.end(), message.begin(), message.end());
+    }
+
+    // everything sent, then the next pong. rejected frames count as failures
+    size_t replyRead = 0;
+    bool waitPong(avr_cycle_count_t& at, double us) {
+        bool ok = run([&] {
+            for (; replyRead < replies.size(); replyRead++) {
+                uint8_t reply = replies[replyRead].second;
+                if (reply == Errors)
+                    fail("the nano rejected a frame");
+                // the interrupt keeps up but loop() didn't, the ring ran full
+                if (reply == Lost)
+                    fail("the nano dropped bytes");
+                if (reply == Pong && toSend.empty()) {
+                    at = replies[replyRead++].first;
+                    return true;
+                }
+            }
+            return false;
+        }, us);
+        if (!ok)
+            fail("no pong");
+        return ok;
+    }
+
+    void clearEdges() {
+        for (auto& pin : pins)
+            pin.edges.clear();
+    }
+
+    // the highs and lows of every frame that went out, over all strips
+    struct Timing {
+        double t0hMin = 1e9, t0hMax = 0;
+        double t1hMin = 1e9, t1hMax = 0;
+        double lowMin = 1e9, lowMax = 0;
+        size_t bad = 0;
+        // by how many lanes went out together, the longest lows between leds and between the bytes of a led in
+        // cycles past the kernel's own longest low. led.hpp only allows for the ones between leds, see ledGapCycles
+        avr_cycle_count_t ledGaps[maxLanes + 1] = { };
+        avr_cycle_count_t byteGaps[maxLanes + 1] = { };
+
+        void print(const char* name) const {
+            printf("%-12s T0H %.0f-%.0f ns, T1H %.0f-%.0f ns, low %.0f-%.0f ns, %zu out of spec\n", name, t0hMin,
+                t0hMax, t1hMin, t1hMax, lowMin, lowMax, bad);
+        }
+
+        void printGaps(uint8_t bits) const {
+            for (size_t lanes = 1; lanes <= maxLanes; lanes++) {
+                if (ledGaps[lanes] == 0 && byteGaps[lanes] == 0)
+                    continue;
+                printf("%-12s %zu lane%s, %llu cycles between leds and %llu between bytes on top of the kernel's low, "
+                    "led.hpp allows %zu between leds\n", "", lanes, lanes > 1 ? "s" : "",
+                    static_cast<unsigned long long>(ledGaps[lanes]), static_cast<unsigned long long>(byteGaps[lanes]),
+                    ledGapCycles(bits, lanes));
+            }
+        }
+
+        void add(const Timing& other) {
+            t0hMin = std::min(t0hMin, other.t0hMin);
+            t0hMax = std::max(t0hMax, other.t0hMax);
+            t1hMin = std::min(t1hMin, other.t1hMin);
+            t1hMax = std::max(t1hMax, other.t1hMax);
+            lowMin = std::min(lowMin, other.lowMin);
+            lowMax = std::max(lowMax, other.lowMax);
+            bad += other.bad;
+        }
+    };
+
+    // the lanes that go out together all fall within a bit of each other at the end of every byte
+    size_t lanesAt(avr_cycle_count_t fall, const std::vector<int>& strips) {
+        const avr_cycle_count_t window = bitCycles[maxLanes];
+        size_t res = 0;
+        for (int pin : strips) {
+            const auto& edges = pins[pin].edges;
+            auto at = std::lower_bound(edges.begin(), edges.end(), std::make_pair(fall - window, false));
+            for (; at != edges.end() && at->first <= fall + window; at++) {
+                if (!at->second) {
+                    res++;
+                    break;
+                }
+            }
+        }
+        return res;
+    }
+
+    // the lows at the end of every byte against the kernel's, that's what loading the next byte or led costs
+    void measureGaps(const std::vector<int>& strips, Timing& timing) {
+        for (int pin : strips) {
+            const auto& edges = pins[pin].edges;
+            size_t bits = 0;
+            for (size_t i = 0; i + 2 < edges.size(); i++) {
+                if (!edges[i].second || edges[i + 1].second)
+                    continue;
+                bits++;
+                avr_cycle_count_t low = edges[i + 2].first - edges[i + 1].first;
+                if (bits % 8 != 0 || low * nsPerCycle >= resetNs)
+                    continue;
+                size_t lanes = std::min(lanesAt(edges[i + 1].first, strips), maxLanes);
+                avr_cycle_count_t kernel = kernelTiming(lanes).lowMax;
+                avr_cycle_count_t gap = low > kernel ? low - kernel : 0;
+                avr_cycle_count_t& longest = bits % 24 == 0 ? timing.ledGaps[lanes] : timing.byteGaps[lanes];
+                longest = std::max(longest, gap);
+            }
+        }
+    }
+
+    // the bits on one pin back into bytes, msb first
+    std::vector<uint8_t> decode(const Pin& pin, Timing& timing) {
+        std::vector<uint8_t> bytes;
+        size_t bits = 0;
+        const auto& edges = pin.edges;
+        for (size_t i = 0; i + 1 < edges.size(); i++) {
+            if (!edges[i].second || edges[i + 1].second)
+                continue;
+            double high = (edges[i + 1].first - edges[i].first) * nsPerCycle;
+            bool one = high >= oneNs;
+            double& min = one ? timing.t1hMin : timing.t0hMin;
+            double& max = one ? timing.t1hMax : timing.t0hMax;
+            min = std::min(min, high);
+            max = std::max(max, high);
+            if (one ? high < t1hMinNs || high > t1hMaxNs : high < t0hMinNs || high > t0hMaxNs)
+                timing.bad++;
+            if (i + 2 < edges.size()) {
+                double low = (edges[i + 2].first - edges[i + 1].first) * nsPerCycle;
+                if (low < resetNs) {
+                    timing.lowMin = std::min(timing.lowMin, low);
+                    timing.lowMax = std::max(timing.lowMax, low);
+                    if (low < lowMinNs || low > lowMaxNs)
+                        timing.bad++;
+                }
+            }
+            if (bits % 8 == 0)
+                bytes.push_back(0);
+            bytes.back() = static_cast<uint8_t>(bytes.back() | (one ? 0x80 >> (bits % 8) : 0));
+            bits++;
+        }
+        return bytes;
+    }
+
+    // which pins have strips, in the order the host sends them, and which way around the colors go
+    struct Layout {
+        std::vector<int> pins;
+        std::vector<size_t> leds;
+        bool grb = true;
+        bool known = false;
+
+        size_t ledCount() const {
+            size_t res = 0;
+            for (size_t count : leds)
+                res += count;
+            return res;
+        }
+
+        std::vector<uint8_t> wire(const std::vector<uint8_t>& frame, size_t start, size_t count, bool grb) const {
+            std::vector<uint8_t> res;
+            for (size_t led = start; led < start + count; led++) {
+                const uint8_t* c = &frame[led * 3];
+                res.insert(res.end(), { grb ? c[1] : c[0], grb ? c[0] : c[1], c[2] });
+            }
+            return res;
+        }
+
+        bool matches(const std::vector<uint8_t>& frame, const std::vector<std::vector<uint8_t>>& out,
+            const std::vector<int>& order, bool tryGrb) const {
+            size_t start = 0;
+            for (int pin : order) {
+                size_t i = std::find(pins.begin(), pins.end(), pin) - pins.begin();
+                if (out[i] != wire(frame, start, leds[i], tryGrb))
+                    return false;
+                start += leds[i];
+            }
+            return true;
+        }
+
+        // the first frame that shows decides, every permutation and both orders
+        bool check(const std::vector<uint8_t>& frame, const std::vector<std::vector<uint8_t>>& out) {
+            if (known)
+                return matches(frame, out, pins, grb);
+            std::vector<int> order = pins;
+            std::sort(order.begin(), order.end());
+            do {
+                for (bool tryGrb : { true, false }) {
+                    if (!matches(frame, out, order, tryGrb))
+                        continue;
+                    std::vector<size_t> sorted;
+                    for (int pin : order)
+                        sorted.push_back(leds[std::find(pins.begin(), pins.end(), pin) - pins.begin()]);
+                    pins = order;
+                    leds = sorted;
+                    grb = tryGrb;
+                    known = true;
+                    return true;
+                }
+            } while (std::next_permutation(order.begin(), order.end()));
+            return false;
+        }
+    } layout;
+
+    uint16_t crcUpdate(uint16_t crc, uint8_t x) {
+        crc ^= static_cast<uint16_t>(x << 8);
+        for (int i = 0; i < 8; i++)
+            crc = static_cast<uint16_t>(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+        return crc;
+    }
+
+    uint8_t sequence = 0;
+    std::vector<uint8_t> framed(const std::vector<uint8_t>& message) {
+        std::vector<uint8_t> res = { Framed, static_cast<uint8_t>(message.size()),
+            static_cast<uint8_t>(message.size() >> 8), sequence++ };
+        res.insert(res.end(), message.begin(), message.end());
+        uint16_t crc = 0xffff;
+        for (size_t i = 1; i < res.size(); i++)
+            crc = crcUpdate(crc, res[i]);
+        res.push_back(static_cast<uint8_t>(crc));
+        res.push_back(static_cast<uint8_t>(crc >> 8));
+        return res;
+    }
+
+    uint32_t seed = 1;
+    uint8_t random8() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<uint8_t>(seed >> 24);
+    }
+
+    // what the host sends and what the strips should end up showing
+    struct Case {
+        const char* name;
+        std::vector<uint8_t> message;
+        std::vector<uint8_t> frame;
+        // what the nano shows it as, 24 for colors and 8 or 4 for palette indices
+        uint8_t bits = 24;
+    };
+
+    // sends it, waits for the pong and checks every strip. false if the nano didn't show anything, which is fine for
+    // frames it doesn't have the room for
+    bool runCase(const Case& c, Timing& total) {
+        clearEdges();
+        send(c.message);
+        avr_cycle_count_t pong = 0;
+        if (!waitPong(pong, 1e6))
+            return false;
+
+        std::vector<std::vector<uint8_t>> out;
+        Timing timing;
+        avr_cycle_count_t first = ~0ull;
+        avr_cycle_count_t last = 0;
+        for (int pin : layout.pins) {
+            out.push_back(decode(pins[pin], timing));
+            if (!pins[pin].edges.empty()) {
+                first = std::min(first, pins[pin].edges.front().first);
+                last = std::max(last, pins[pin].edges.back().first);
+            }
+        }
+        // the last byte is all there 80 cycles after it started
+        double latency = cyclesToUs(pong - (lastSent + cyclesPerByte));
+        if (last == 0) {
+            printf("%-12s not shown, the nano doesn't keep these (frameBits), pong after %.0f us\n", c.name, latency);
+            return false;
+        }
+        double showing = cyclesToUs(last - first);
+        measureGaps(layout.pins, timing);
+        timing.print(c.name);
+        timing.printGaps(c.bits);
+        printf("%-12s frame to pong %.0f us, %.0f us of that writing the strips\n", "", latency, showing);
+        if (timing.bad > 0)
+            fail("strip timing out of the datasheet's windows");
+        for (size_t lanes = 1; lanes <= maxLanes; lanes++) {
+            if (timing.ledGaps[lanes] > ledGapCycles(c.bits, lanes))
+                fail("the gap between leds is longer than led.hpp's ledGapCycles");
+        }
+        if (latency > showing + pongSlackUs)
+            fail("pong took too long");
+        if (!layout.check(c.frame, out))
+            fail("the strips don't show what was sent");
+        total.add(timing);
+        return true;
+    }
+
+    std::vector<uint8_t> randomFrame(size_t ledCount) {
+        std::vector<uint8_t> frame(ledCount * 3);
+        for (auto& x : frame)
+            x = random8();
+        return frame;
+    }
+
+    Case dataCase(const char* name, const std::vector<uint8_t>& frame) {
+        std::vector<uint8_t> message = { Data };
+        message.insert(message.end(), frame.begin(), frame.end());
+        message.push_back(Ping);
+        return { name, message, frame };
+    }
+
+    // u8 bits, u8 palette size - 1 and the palette, then the indices
+    Case indexedCase(const char* name, uint8_t bits, size_t colors) {
+        const size_t ledCount = layout.ledCount();
+        std::vector<uint8_t> palette(colors * 3);
+        for (auto& x : palette)
+            x = random8();
+        std::vector<uint8_t> message = { Indexed, bits, static_cast<uint8_t>(colors - 1) };
+        message.insert(message.end(), palette.begin(), palette.end());
+        std::vector<uint8_t> frame(ledCount * 3);
+        std::vector<uint8_t> indices(bits == 4 ? (ledCount + 1) / 2 : ledCount);
+        for (size_t led = 0; led < ledCount; led++) {
+            uint8_t index = static_cast<uint8_t>(random8() % colors);
+            memcpy(&frame[led * 3], &palette[index * 3], 3);
+            if (bits == 8)
+                indices[led] = index;
+            else
+                indices[led / 2] |= led & 1 ? index << 4 : index;
+        }
+        message.insert(message.end(), indices.begin(), indices.end());
+        message.push_back(Ping);
+        return { name, message, frame, bits };
+    }
+
+    // a frame's pong comes on its own, the ping at the end is dropped
+    Case frameCase(const char* name, Case c) {
+        c.message.pop_back();
+        c.message = framed(c.message);
+        return { name, c.message, c.frame, c.bits };
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <firmware.elf>\n", argv[0]);
+        return 2;
+    }
+
+    elf_firmware_t firmware = { };
+    if (elf_read_firmware(argv[1], &firmware) != 0) {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 2;
+    }
+    strcpy(firmware.mmcu, "atmega328p");
+    firmware.frequency = frequency;
+    avr = avr_make_mcu_by_name(firmware.mmcu);
+    if (!avr) {
+        fprintf(stderr, "simavr doesn't know the %s\n", firmware.mmcu);
+        return 2;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+
+    // the replies come here instead of stdout
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    uartIn = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), onReply, nullptr);
+    avr_cycle_timer_register(avr, cyclesPerByte, feed, nullptr);
+    for (int pin = 2; pin < 20; pin++) {
+        char port = pin < 8 ? 'D' : pin < 14 ? 'B' : 'C';
+        int bit = pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14;
+        avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit), onPin, &pins[pin]);
+    }
+
+    if (!run([] { return !replies.empty() && replies.back().second == Ready; }, 500000)) {
+        printf("failed: the nano never said it's ready\n");
+        return 1;
+    }
+
+    // freddy is the only thing that shows without being sent a frame, which says where the strips are and how long
+    clearEdges();
+    send({ Power, 2 });
+    auto quiet = [] {
+        avr_cycle_count_t last = 0;
+        for (const auto& pin : pins)
+            last = pin.edges.size() >= 48 ? std::max(last, pin.edges.back().first) : last;
+        return last > 0 && avr->cycle - last > usToCycles(resetNs * 2 / 1000);
+    };
+    if (!run(quiet, 1e6)) {
+        printf("failed: freddy never showed up on any strip\n");
+        return 1;
+    }
+    for (int pin = 0; pin < 20; pin++) {
+        size_t bits = pins[pin].edges.size() / 2;
+        if (bits < 24)
+            continue;
+        if (bits % 24 != 0)
+            fail("a strip got a partial led");
+        layout.pins.push_back(pin);
+        layout.leds.push_back(bits / 24);
+        printf("pin %-2d %zu leds\n", pin, bits / 24);
+    }
+    // freddy off, and the relay with him. he blinks on his own so this can come while the strips are being written and
+    // get lost, which is fine here, the nano says so and it just gets sent again
+    bool off = false;
+    for (int tries = 0; tries < 5 && !off; tries++) {
+        send({ Power, 0, Ping });
+        off = run([] {
+            for (; replyRead < replies.size(); replyRead++) {
+                if (replies[replyRead].second == Pong)
+                    return true;
+            }
+            return false;
+        }, 20000);
+    }
+    if (!off) {
+        printf("failed: freddy never went away\n");
+        return 1;
+    }
+    // whatever the nano has left to say about that comes right after the pong
+    run([] { return false; }, 1000);
+    replyRead = replies.size();
+    overruns = 0;
+
+    const size_t ledCount = layout.ledCount();
+    Timing total;
+    // a nano that keeps plain colors shows everything, one that doesn't has to show at least the 4 bit frames
+    std::vector<uint8_t> frame = randomFrame(ledCount);
+    const bool colors = runCase(dataCase("data", frame), total);
+    if (colors) {
+        // a few spans on top of that
+        std::vector<uint8_t> message = { Spans, 3, 0 };
+        for (size_t start : { size_t(0), ledCount / 2, ledCount - 1 }) {
+            size_t count = std::min<size_t>(5, ledCount - start);
+            message.insert(message.end(), { static_cast<uint8_t>(start), static_cast<uint8_t>(start >> 8),
+                static_cast<uint8_t>(count), static_cast<uint8_t>(count >> 8) });
+            for (size_t i = start * 3; i < (start + count) * 3; i++) {
+                frame[i] = random8();
+                message.push_back(frame[i]);
+            }
+        }
+        message.push_back(Ping);
+        if (!runCase({ "spans", message, frame }, total))
+            fail("spans didn't show");
+        if (!runCase(frameCase("framed data", dataCase("", randomFrame(ledCount))), total))
+            fail("a framed frame didn't show");
+    }
+    // a palette that still fits next to the indices in a frame's worth of colors
+    if (!runCase(indexedCase("indexed 8", 8, 64), total) && colors)
+        fail("an 8 bit frame didn't show");
+    if (!runCase(indexedCase("indexed 4", 4, 16), total))
+        fail("a 4 bit frame didn't show");
+    if (!runCase(frameCase("framed 4", indexedCase("", 4, 9)), total))
+        fail("a framed 4 bit frame didn't show");
+    printf("%zu strips on pins", layout.pins.size());
+    for (int pin : layout.pins)
+        printf(" %d", pin);
+    printf(", %s\n", layout.grb ? "grb" : "rgb");
+    total.print("all frames");
+
+    // 2mbaud leaves 80 cycles a byte for the interrupt and the parsing together
+    printf("rx interrupt %llu cycles at most, %zu bytes the uart would have dropped\n",
+        static_cast<unsigned long long>(rxLongest), overruns);
+    if (rxLongest >= cyclesPerByte)
+        fail("the rx interrupt alone takes longer than a byte");
+    if (overruns > 0)
+        fail("bytes lost in the uart");
+
+    printf("%s\n", failures == 0 ? "all good" : "failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -14,52 +14,360 @@ struct led_data {
     constexpr led_data(uint8_t pin, size_t count) : pin(pin), size(count * 3) { }
 };
 
-struct pin_data {
-    size_t start, end;
-    uint8_t pin;
-    volatile uint8_t* _dat_port;
-    uint8_t _dat_mask, _mask_h, _mask_l;
-
-    pin_data() {}
-
-    pin_data(uint8_t pin, size_t start, size_t size) {
-        this->pin = pin;
-        this->start = start;
-        this->end = start + size;
-        _dat_mask = digitalPinToBitMask(pin);
-        _dat_port = portOutputRegister(digitalPinToPort(pin));
-        *portModeRegister(digitalPinToPort(pin)) |= _dat_mask;
+// the nano's pins as io register and bit, sbi/cbi only take those as constants.
+// 0-7 are PORTD, 8-13 PORTB and 14-19 (A0-A5) PORTC
+constexpr uint8_t pinPort(uint8_t pin) { return pin < 8 ? 0x0b : pin < 14 ? 0x05 : 0x08; }
+constexpr uint8_t pinBit(uint8_t pin) { return pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14; }
+
+// how many strips get driven at once at most, every extra one makes each bit take longer. with a 4th the first
+// lane's one bits stay high for 17-20 cycles (1.06-1.25us), way past what a ws2812 reads as a one
+constexpr size_t maxLanes = 3;
+
+// one bit of the sendRaw's below as data so the timings can be checked at compile time instead of trusting
+// the cycle comments, sim/kernels.cpp runs their asm to check the two agree. every lane goes high, sbrs/cbi drops
+// the ones that send a 0 and the tail drops the rest. with more than one lane the next lane's sbi goes in between so
+// a 0 stays high long enough
+struct led_op {
+    enum kind_t : uint8_t { rise, skipIfOne, fall, wait } kind;
+    // lane, or cycles for wait
+    uint8_t arg;
+};
+
+struct led_kernel {
+    led_op ops[maxLanes * 5 + 4] = { };
+    size_t count = 0;
+
+    constexpr void add(led_op::kind_t kind, uint8_t arg) { ops[count++] = { kind, arg }; }
+    constexpr void test(uint8_t lane) {
+        add(led_op::skipIfOne, lane);
+        add(led_op::fall, lane);
     }
+};
 
-    inline void update() {
-        _mask_h = _dat_mask | *_dat_port;
-        _mask_l = ~_dat_mask & *_dat_port;
+constexpr led_kernel kernelOps(size_t lanes) {
+    led_kernel res { };
+    if(lanes == 1) {
+        res.add(led_op::rise, 0);
+        // 2 nops
+        res.add(led_op::wait, 2);
+        res.test(0);
+        // lsl, ldi and the dec/brne loop
+        res.add(led_op::wait, 7);
+        res.add(led_op::fall, 0);
+        // 3 nops
+        res.add(led_op::wait, 3);
+    }
+    if(lanes == 2) {
+        res.add(led_op::rise, 0);
+        res.add(led_op::rise, 1);
+        res.test(0);
+        res.test(1);
+        // 2 lsl, 3 nops
+        res.add(led_op::wait, 5);
+        res.add(led_op::fall, 0);
+        res.add(led_op::fall, 1);
+        // nop
+        res.add(led_op::wait, 1);
+    }
+    if(lanes == 3) {
+        res.add(led_op::rise, 0);
+        res.add(led_op::rise, 1);
+        res.test(0);
+        res.add(led_op::rise, 2);
+        res.test(1);
+        res.test(2);
+        res.add(led_op::fall, 0);
+        res.add(led_op::fall, 1);
+        // 2 lsl
+        res.add(led_op::wait, 2);
+        res.add(led_op::fall, 2);
+        // lsl
+        res.add(led_op::wait, 1);
     }
+    return res;
+}
+
+// in cycles, over every combination of bits on all lanes. low is from the end of one bit to the start of the next
+struct led_timing {
+    size_t t0hMin = static_cast<size_t>(-1), t0hMax = 0;
+    size_t t1hMin = static_cast<size_t>(-1), t1hMax = 0;
+    size_t lowMin = static_cast<size_t>(-1), lowMax = 0;
+    size_t period = 0;
 };
 
-template<M_order order, pin_data* pins, size_t count, uint8_t* data>
+// sbi/cbi change the pin in their last cycle, sbrs takes 2 cycles when it skips
+constexpr size_t runKernel(const led_kernel& kernel, size_t bits, size_t* rises, size_t* falls) {
+    size_t t = 0;
+    bool skip = false;
+    for(size_t i = 0; i < maxLanes; i++)
+        falls[i] = 0;
+    for(size_t i = 0; i < kernel.count; i++) {
+        const led_op& op = kernel.ops[i];
+        if(skip) {
+            skip = false;
+            continue;
+        }
+        switch(op.kind) {
+            case led_op::rise:
+                t += 2;
+                rises[op.arg] = t;
+                break;
+            case led_op::skipIfOne:
+                skip = (bits >> op.arg) & 1;
+                t += skip ? 2 : 1;
+                break;
+            case led_op::fall:
+                t += 2;
+                if(falls[op.arg] == 0)
+                    falls[op.arg] = t;
+                break;
+            case led_op::wait:
+                t += op.arg;
+                break;
+        }
+    }
+    return t;
+}
+
+constexpr led_timing kernelTiming(size_t lanes) {
+    led_kernel kernel = kernelOps(lanes);
+    led_timing res { };
+    for(size_t bits = 0; bits < (1u << lanes); bits++) {
+        for(size_t nextBits = 0; nextBits < (1u << lanes); nextBits++) {
+            size_t rises[maxLanes] = { }, falls[maxLanes] = { };
+            size_t nextRises[maxLanes] = { }, nextFalls[maxLanes] = { };
+            size_t length = runKernel(kernel, bits, rises, falls);
+            runKernel(kernel, nextBits, nextRises, nextFalls);
+            res.period = length > res.period ? length : res.period;
+            for(size_t j = 0; j < lanes; j++) {
+                size_t high = falls[j] - rises[j];
+                size_t low = length + nextRises[j] - falls[j];
+                bool one = (bits >> j) & 1;
+                size_t& highMin = one ? res.t1hMin : res.t0hMin;
+                size_t& highMax = one ? res.t1hMax : res.t0hMax;
+                highMin = high < highMin ? high : highMin;
+                highMax = high > highMax ? high : highMax;
+                res.lowMin = low < res.lowMin ? low : res.lowMin;
+                res.lowMax = low > res.lowMax ? low : res.lowMax;
+            }
+        }
+    }
+    return res;
+}
+
+// the ws2812b datasheet's T0H of 0.4us and T1H of 0.8us, both +-150ns, and lows of at least T1L's 0.45us - 150ns.
+// it only says a low past 50us resets, older strips latch after about 5us already so lows stay under that, the gap
+// between leds (loading the next colors) included
+constexpr uint32_t ws2812T0hMinNs = 250;
+constexpr uint32_t ws2812T0hMaxNs = 550;
+constexpr uint32_t ws2812T1hMinNs = 650;
+constexpr uint32_t ws2812T1hMaxNs = 950;
+constexpr uint32_t ws2812LowMinNs = 300;
+constexpr uint32_t ws2812LowMaxNs = 5000;
+
+constexpr uint32_t cyclesToNs(size_t cycles) { return static_cast<uint32_t>(cycles * 1000000000ull / F_CPU); }
+
+constexpr bool kernelTimingOk(size_t lanes) {
+    led_timing t = kernelTiming(lanes);
+    return cyclesToNs(t.t0hMin) >= ws2812T0hMinNs && cyclesToNs(t.t0hMax) <= ws2812T0hMaxNs &&
+        cyclesToNs(t.t1hMin) >= ws2812T1hMinNs && cyclesToNs(t.t1hMax) <= ws2812T1hMaxNs &&
+        cyclesToNs(t.lowMin) >= ws2812LowMinNs && cyclesToNs(t.lowMax) <= ws2812LowMaxNs;
+}
+static_assert(kernelTimingOk(1), "1 lane sendRaw is out of ws2812 timings");
+static_assert(kernelTimingOk(2), "2 lane sendRaw is out of ws2812 timings");
+static_assert(kernelTimingOk(3), "3 lane sendRaw is out of ws2812 timings");
+
+// cycles per bit when sending to that many strips at once
+constexpr size_t bitCycles[maxLanes + 1] = { 0, kernelTiming(1).period, kernelTiming(2).period, kernelTiming(3).period };
+
+// cycles between the last bit of one led and the first of the next on top of the kernel's own low: the loop, and for
+// every lane stepping to its next color (24 bits) or loading its index and looking that up in the palette (8 and 4).
+// counted by hand from what color<bits> should come out as, ledsim measures the real gaps off the built firmware and
+// fails past these
+constexpr size_t ledGapCycles(uint8_t bits, size_t lanes) {
+    return 8 + lanes * (bits == 24 ? 4 : bits == 8 ? 12 : 18);
+}
+
+// whether the strips still take the gap between leds for a low and not for the end of the frame
+constexpr bool ledGapOk(uint8_t bits, size_t lanes) {
+    return cyclesToNs(kernelTiming(lanes).lowMax + ledGapCycles(bits, lanes)) <= ws2812LowMaxNs;
+}
+static_assert(ledGapOk(24, 1) && ledGapOk(8, 1) && ledGapOk(4, 1), "even one lane can't look up the next led in time");
+
+// which strips go out together and for how long, every strip ends a segment at most once
+template<size_t Count>
+struct led_schedule {
+    struct segment {
+        // bytes per strip
+        size_t length = 0;
+        size_t lanes = 0;
+        size_t strips[maxLanes] = { };
+        // where in data each strip is at when the segment starts
+        size_t offsets[maxLanes] = { };
+    };
+
+    segment segments[Count] = { };
+    size_t segmentCount = 0;
+    size_t cycles = 0;
+
+    // longest strip first onto whichever lane frees up the earliest, then all lanes step together
+    // and a new segment starts whenever one of them moves on to its next strip
+    static constexpr led_schedule make(const led_data* strips, size_t lanes) {
+        led_schedule res { };
+
+        size_t starts[Count] = { };
+        size_t order[Count] = { };
+        for(size_t i = 0; i < Count; i++) {
+            starts[i] = i == 0 ? 0 : starts[i - 1] + strips[i - 1].size;
+            size_t j = i;
+            for(; j > 0 && strips[order[j - 1]].size < strips[i].size; j--)
+                order[j] = order[j - 1];
+            order[j] = i;
+        }
+
+        size_t laneStrips[maxLanes][Count] = { };
+        size_t laneCounts[maxLanes] = { };
+        size_t laneLoads[maxLanes] = { };
+        for(size_t i = 0; i < Count; i++) {
+            size_t lane = 0;
+            for(size_t l = 1; l < lanes; l++) {
+                if(laneLoads[l] < laneLoads[lane])
+                    lane = l;
+            }
+            laneStrips[lane][laneCounts[lane]++] = order[i];
+            laneLoads[lane] += strips[order[i]].size;
+        }
+
+        size_t next[maxLanes] = { };
+        size_t done[maxLanes] = { };
+        while(true) {
+            segment s { };
+            for(size_t l = 0; l < lanes; l++) {
+                if(next[l] >= laneCounts[l])
+                    continue;
+                size_t strip = laneStrips[l][next[l]];
+                size_t remaining = strips[strip].size - done[l];
+                s.strips[s.lanes] = strip;
+                s.offsets[s.lanes] = starts[strip] + done[l];
+                s.length = s.lanes == 0 || remaining < s.length ? remaining : s.length;
+                s.lanes++;
+            }
+            if(s.lanes == 0)
+                break;
+            for(size_t l = 0; l < lanes; l++) {
+                if(next[l] >= laneCounts[l])
+                    continue;
+                done[l] += s.length;
+                if(done[l] == strips[laneStrips[l][next[l]]].size) {
+                    next[l]++;
+                    done[l] = 0;
+                }
+            }
+            res.segments[res.segmentCount++] = s;
+            res.cycles += s.length * 8 * bitCycles[s.lanes];
+        }
+        return res;
+    }
+
+    // more lanes only pay off while the strips are long enough to keep them busy, and only as many as can get their
+    // next led ready between leds
+    static constexpr led_schedule best(const led_data* strips, uint8_t bits) {
+        led_schedule res = make(strips, 1);
+        for(size_t lanes = 2; lanes <= maxLanes && lanes <= Count && ledGapOk(bits, lanes); lanes++) {
+            led_schedule candidate = make(strips, lanes);
+            if(candidate.cycles < res.cycles)
+                res = candidate;
+        }
+        return res;
+    }
+};
+
+template<M_order order, const led_data* strips, size_t count, uint8_t* data>
 class microLed {
 public:
     microLed() {}
 
+    static void begin() {
+        for(size_t i = 0; i < count; i++)
+            pinMode(strips[i].pin, OUTPUT);
+    }
+
+    // bits is 24 for plain colors, or 4/8 when data holds that many bits of palette index per led
+    // with the palette behind them, see paletteOffset
+    template<uint8_t bits = 24>
     __attribute__((optimize("unroll-loops")))
     static inline void show() {
+        static_assert(bits == 24 || bits == 8 || bits == 4, "leds are either colors or 4/8 bit palette indices");
+        showSegment<bits, 0>();
+    }
+
+    static constexpr size_t ledCount() {
+        size_t res = 0;
         for(size_t i = 0; i < count; i++)
-            pins[i].update();
-
-        // TODO: implement counts other than 3
-        pin_data pin0 = pins[0];
-        pin_data pin1 = pins[1];
-        pin_data pin2 = pins[2];
-        size_t i0 = pin0.start;
-        for(size_t i = pin1.start; i < pin1.end; i += 3) {
-            send<0, 1>(i0, i);
-            i0 += 3;
+            res += strips[i].size / 3;
+        return res;
+    }
+
+    // where the palette starts in data, right after the indices of all leds
+    static constexpr size_t paletteOffset(uint8_t bits) {
+        return bits == 4 ? (ledCount() + 1) / 2 : ledCount();
+    }
+
+    // every kind of frame gets its own, palette lookups leave time for fewer lanes
+    template<uint8_t bits>
+    static constexpr led_schedule<count> schedule = led_schedule<count>::best(strips, bits);
+
+private:
+    static constexpr bool validPins() {
+        for(size_t i = 0; i < count; i++) {
+            if(strips[i].pin >= 20 || strips[i].size == 0)
+                return false;
         }
-        for(; i0 < pin0.end; i0 += 3)
-            send<0>(i0);
-        for(size_t i = pin2.start; i < pin2.end; i += 3)
-            send<2>(i);
+        return true;
+    }
+    static_assert(validPins(), "strips have to be on pins 0-19 (D0-D13, A0-A5) and not empty");
+
+    template<uint8_t bits>
+    static constexpr uint8_t lanePin(size_t segment, size_t lane) {
+        constexpr const led_schedule<count>& s = schedule<bits>;
+        return lane < s.segments[segment].lanes ? strips[s.segments[segment].strips[lane]].pin : 0;
+    }
+
+    // segments start and end on whole leds, so everything in here counts leds and never has to divide by 3
+    template<uint8_t bits, size_t segment>
+    static inline void showSegment() {
+        constexpr const led_schedule<count>& s = schedule<bits>;
+        constexpr size_t lanes = s.segments[segment].lanes;
+        constexpr size_t leds = s.segments[segment].length / 3;
+        constexpr size_t led0 = s.segments[segment].offsets[0] / 3;
+        constexpr size_t led1 = s.segments[segment].offsets[1] / 3;
+        constexpr size_t led2 = s.segments[segment].offsets[2] / 3;
+        constexpr uint8_t pin0 = lanePin<bits>(segment, 0);
+        constexpr uint8_t pin1 = lanePin<bits>(segment, 1);
+        constexpr uint8_t pin2 = lanePin<bits>(segment, 2);
+        for(size_t i = 0; i < leds; i++) {
+            if constexpr (lanes == 1)
+                send<pin0>(color<bits>(led0 + i));
+            else if constexpr (lanes == 2)
+                send<pin0, pin1>(color<bits>(led0 + i), color<bits>(led1 + i));
+            else
+                send<pin0, pin1, pin2>(color<bits>(led0 + i), color<bits>(led1 + i), color<bits>(led2 + i));
+        }
+        if constexpr (segment + 1 < s.segmentCount)
+            showSegment<bits, segment + 1>();
+    }
+
+    // the palette lookup happens between leds where all the strips just see a longer low, see ledGapCycles
+    template<uint8_t bits>
+    static inline const uint8_t* color(size_t led) {
+        if constexpr (bits == 24)
+            return &data[led * 3];
+        uint8_t index;
+        if constexpr (bits == 8)
+            index = data[led];
+        else
+            index = led & 1 ? data[led / 2] >> 4 : data[led / 2] & 0x0f;
+        return &data[paletteOffset(bits) + index * 3];
     }
 
     // cycle = 0.0625us
@@ -90,264 +398,105 @@ public:
             "NOP                       \n\t" // 1c
     */
 
-    template<size_t pin0>
-    static inline void send(size_t i0) {
+    // one led per strip, all of them at once
+    template<uint8_t... pins, typename... Color>
+    static inline void send(Color... c) {
         if constexpr (order == M_order::ORDER_RGB) {
-            sendRaw<pin0>(data[i0]);
-            sendRaw<pin0>(data[i0 + 1]);
-            sendRaw<pin0>(data[i0 + 2]);
+            sendRaw<pins...>(c[0]...);
+            sendRaw<pins...>(c[1]...);
+            sendRaw<pins...>(c[2]...);
         }
         else if constexpr (order == M_order::ORDER_GRB) {
-            sendRaw<pin0>(data[i0 + 1]);
-            sendRaw<pin0>(data[i0]);
-            sendRaw<pin0>(data[i0 + 2]);
+            sendRaw<pins...>(c[1]...);
+            sendRaw<pins...>(c[0]...);
+            sendRaw<pins...>(c[2]...);
         }
     }
 
-    template<size_t pin0, size_t pin1>
-    static inline void send(size_t i0, size_t i1) {
-        if constexpr (order == M_order::ORDER_RGB) {
-            sendRaw<pin0, pin1>(data[i0], data[i1]);
-            sendRaw<pin0, pin1>(data[i0 + 1], data[i1 + 1]);
-            sendRaw<pin0, pin1>(data[i0 + 2], data[i1 + 2]);
-        }
-        else if constexpr (order == M_order::ORDER_GRB) {
-            sendRaw<pin0, pin1>(data[i0 + 1], data[i1 + 1]);
-            sendRaw<pin0, pin1>(data[i0], data[i1]);
-            sendRaw<pin0, pin1>(data[i0 + 2], data[i1 + 2]);
-        }
-    }
-
-    template<size_t pin0>
-    //__attribute__((optimize("unroll-loops")))
-    static inline void sendRaw(uint8_t x) {
-        //for(size_t i = 0; i < 8; ++i) {
-            asm volatile
-            (
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_0_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_0_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_1_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_1_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_2_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_2_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
+    // sbi/cbi take as long as a store through X but leave the other pins of the port alone,
+    // so any strips can share a port and nothing has to be read from the port beforehand
 
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_3_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_3_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_4_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_4_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_5_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_5_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_6_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_6_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "LDI r20, 3                \n\t" // 1c
-            "_DELAY_LOOP_7_%=:         \n\t"
-            "DEC r20                   \n\t" // 1c
-            "BRNE _DELAY_LOOP_7_%=     \n\t" // 2c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            :
-            : "x" (pins[pin0]._dat_port),
-              [DATA_0] "r" (x),
-              [SET_H_0] "r" (pins[pin0]._mask_h),
-              [SET_L_0] "r" (pins[pin0]._mask_l)
-            : "r20"
-            );
-        //}
+    template<uint8_t pin0>
+    static inline void sendRaw(uint8_t x0) {
+        // 18-19c per bit
+        asm volatile
+        (
+        ".rept 8                   \n\t"
+        "SBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "NOP                       \n\t" // 1c
+        "NOP                       \n\t" // 1c
+        "SBRS %[DATA_0], 7         \n\t" // 1c
+        "CBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "LSL %[DATA_0]             \n\t" // 1c
+        "LDI r20, 2                \n\t" // 1c
+        "1:                        \n\t"
+        "DEC r20                   \n\t" // 1c
+        "BRNE 1b                   \n\t" // 2c/1c
+        "CBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "NOP                       \n\t" // 1c
+        "NOP                       \n\t" // 1c
+        "NOP                       \n\t" // 1c
+        ".endr                     \n\t"
+        : [DATA_0] "+r" (x0)
+        : [PORT_0] "I" (pinPort(pin0)), [BIT_0] "I" (pinBit(pin0))
+        : "r20"
+        );
     }
 
-    template<size_t pin0, size_t pin1>
-    //__attribute__((optimize("unroll-loops")))
-    static inline void sendRaw(uint8_t x, uint8_t y) {
-        //for(size_t i = 0; i < 8; ++i) {
-            asm volatile
-            (
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
+    template<uint8_t pin0, uint8_t pin1>
+    static inline void sendRaw(uint8_t x0, uint8_t x1) {
+        // 18-20c per bit
+        asm volatile
+        (
+        ".rept 8                   \n\t"
+        "SBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "SBI %[PORT_1], %[BIT_1]   \n\t" // 2c
+        "SBRS %[DATA_0], 7         \n\t" // 1c
+        "CBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "SBRS %[DATA_1], 7         \n\t" // 1c
+        "CBI %[PORT_1], %[BIT_1]   \n\t" // 2c
+        "LSL %[DATA_0]             \n\t" // 1c
+        "LSL %[DATA_1]             \n\t" // 1c
+        "NOP                       \n\t" // 1c
+        "NOP                       \n\t" // 1c
+        "NOP                       \n\t" // 1c
+        "CBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "CBI %[PORT_1], %[BIT_1]   \n\t" // 2c
+        "NOP                       \n\t" // 1c
+        ".endr                     \n\t"
+        : [DATA_0] "+r" (x0), [DATA_1] "+r" (x1)
+        : [PORT_0] "I" (pinPort(pin0)), [BIT_0] "I" (pinBit(pin0)),
+          [PORT_1] "I" (pinPort(pin1)), [BIT_1] "I" (pinBit(pin1))
+        );
+    }
 
-            "ST X, %[SET_H_0]          \n\t" // 2c
-            "SBRS %[DATA_0], 7         \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "ST Z, %[SET_H_1]          \n\t" // 2c
-            "SBRS %[DATA_1], 7         \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_0]             \n\t" // 1c
-            "ST X, %[SET_L_0]          \n\t" // 2c
-            "NOP                       \n\t" // 1c
-            "LSL %[DATA_1]             \n\t" // 1c
-            "ST Z, %[SET_L_1]          \n\t" // 2c
-            :
-            : "x" (pins[pin0]._dat_port),
-              "z" (pins[pin1]._dat_port),
-              [DATA_0] "r" (x),
-              [DATA_1] "r" (y),
-              [SET_H_0] "r" (pins[pin0]._mask_h),
-              [SET_H_1] "r" (pins[pin1]._mask_h),
-              [SET_L_0] "r" (pins[pin0]._mask_l),
-              [SET_L_1] "r" (pins[pin1]._mask_l)
-            );
-        //}
+    // the third lane's sbi goes between the first two lanes' tests, see kernelOps
+    template<uint8_t pin0, uint8_t pin1, uint8_t pin2>
+    static inline void sendRaw(uint8_t x0, uint8_t x1, uint8_t x2) {
+        // 21-24c per bit
+        asm volatile
+        (
+        ".rept 8                   \n\t"
+        "SBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "SBI %[PORT_1], %[BIT_1]   \n\t" // 2c
+        "SBRS %[DATA_0], 7         \n\t" // 1c
+        "CBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "SBI %[PORT_2], %[BIT_2]   \n\t" // 2c
+        "SBRS %[DATA_1], 7         \n\t" // 1c
+        "CBI %[PORT_1], %[BIT_1]   \n\t" // 2c
+        "SBRS %[DATA_2], 7         \n\t" // 1c
+        "CBI %[PORT_2], %[BIT_2]   \n\t" // 2c
+        "CBI %[PORT_0], %[BIT_0]   \n\t" // 2c
+        "CBI %[PORT_1], %[BIT_1]   \n\t" // 2c
+        "LSL %[DATA_0]             \n\t" // 1c
+        "LSL %[DATA_1]             \n\t" // 1c
+        "CBI %[PORT_2], %[BIT_2]   \n\t" // 2c
+        "LSL %[DATA_2]             \n\t" // 1c
+        ".endr                     \n\t"
+        : [DATA_0] "+r" (x0), [DATA_1] "+r" (x1), [DATA_2] "+r" (x2)
+        : [PORT_0] "I" (pinPort(pin0)), [BIT_0] "I" (pinBit(pin0)),
+          [PORT_1] "I" (pinPort(pin1)), [BIT_1] "I" (pinBit(pin1)),
+          [PORT_2] "I" (pinPort(pin2)), [BIT_2] "I" (pinBit(pin2))
+        );
     }
 };
@@ -2,6 +2,7 @@
 #define NO_CLOCK_CORRECTION 1
 
 #include <Arduino.h>
+#include <util/crc16.h>
 #include "led.hpp"
 #include "uart.hpp"
 
@@ -11,8 +12,12 @@ constexpr uint8_t relayPin = 3;
 
 constexpr M_order stripsOrder = M_order::ORDER_GRB;
 constexpr size_t stripCount = 3;
-// have to be sorted by led count in descending order!
+// in the order the host sends them, which strips get driven together is worked out at compile time
 constexpr led_data strips[stripCount] = { led_data(5, 177), led_data(9, 82), led_data(6, 30) };
+// 24 keeps room for a frame of plain colors. 8 or 4 only makes room for indexed frames of up to that many bits and
+// their palette, that pays off past 384 leds with 8 and lets the strips be about 6 times longer with 4. the host has
+// to send indexed frames then (the plugin's indexed setting), plain colors and spans get ignored
+constexpr uint8_t frameBits = 24;
 
 // ----------------
 
@@ -25,123 +30,537 @@ constexpr size_t arraySum(const led_data (&arr)[Size]) {
     return ret;
 }
 constexpr size_t totalDataCount = arraySum(strips);
-
-template<size_t Index, uint8_t* Data, const led_data* Strips, pin_data* Pins>
-struct add_leds_at {
-    constexpr add_leds_at() {
-        size_t ledStart = 0;
-        for(size_t i = 0; i < Index; ++i)
-            ledStart += Strips[i].size;
-        led_data ledData = Strips[Index];
-        Pins[Index] = pin_data(ledData.pin, ledStart, ledData.size);
-        if constexpr (Index + 1 < stripCount)
-            add_leds_at<Index + 1, Data, Strips, Pins>();
-    }
-};
+constexpr size_t totalLedCount = totalDataCount / 3;
+static_assert(frameBits == 24 || frameBits == 8 || frameBits == 4, "frames are either colors or 4/8 bit palette indices");
+constexpr size_t dataSize = frameBits == 24 ? totalDataCount :
+    frameBits == 8 ? totalLedCount + 256 * 3 : (totalLedCount + 1) / 2 + 16 * 3;
 
 enum class DataType : uint8_t {
     Power,
     Data,
-    Ping
+    Ping,
+    Spans,
+    Compressed,
+    Credits,
+    // u8 index bits (4 or 8), u8 palette size - 1 and the palette, then an index for every led,
+    // two per byte low nibble first with 4 bits. has to fit into data, see microLed::paletteOffset and frameBits
+    Indexed,
+    // u16 length, u8 sequence, then a message of that length (its type and payload) and the crc-16 of all of it,
+    // answered with a pong on its own
+    Framed = 0xa5
 };
 
-pin_data pins[stripCount];
-uint8_t data[totalDataCount];
+enum class ReplyType : uint8_t {
+    Pong = 0,
+    Ready = 1,
+    Credits = 0x40,
+    // how many framed messages were rejected or never arrived, none of them get a pong
+    Errors = 0x41,
+    // how many bytes the uart dropped since the last one, the ring was full or the strips were being written
+    Lost = 0x44
+};
+
+uint8_t data[dataSize];
+// 24 while data holds colors, otherwise it's palette indices
+uint8_t dataBits = frameBits;
 bool pendingShow = false;
 
+// commands get parsed a byte at a time out of the uart's ring from loop(), so nothing ever sits waiting on the host
+enum class State : uint8_t {
+    Type,
+    Power,
+    Data,
+    SpanCount,
+    SpanHeader,
+    SpanData,
+    IndexedHeader,
+    IndexedPalette,
+    IndexedData,
+    // the message inside a frame is done, whatever is left of its payload doesn't matter
+    Skip
+};
+State state = State::Type;
+// the u16's and such of whatever is being parsed
+uint8_t header[4];
+uint8_t headerSize = 0;
+size_t cursor = 0;
+size_t cursorEnd = 0;
+uint16_t spansLeft = 0;
+uint8_t indexedBits = 0;
+bool paletteFits = false;
+
+// no ram for a second frame so framed messages go straight into data with the crc kept on the side,
+// a bad one just doesn't get shown. after that everything up to the next marker is skipped
+enum class Frame : uint8_t {
+    None,
+    Header,
+    Payload,
+    Crc
+};
+constexpr size_t maxFrameSize = 1 + 2 + totalDataCount;
+Frame frame = Frame::None;
+uint16_t frameRemaining = 0;
+uint16_t frameCrc = 0;
+uint8_t frameSequence = 0;
+// while hunting the marker might just be a byte out of some payload, only real frames count as errors
+bool frameCounts = false;
+// the relay only switches once the crc checks out
+bool framedPower = false;
+uint8_t framedPowerValue = 0;
+uint8_t nextSequence = 0;
+bool sequenceKnown = false;
+bool hunting = false;
+uint32_t lastByte = 0;
+constexpr uint32_t huntingTimeoutMs = 50;
+
 // freddor
 bool freddy = false;
 bool freddyShown = true;
 const uint8_t freddyBrightness = 63;
 bool wasPowered = false;
+// the blinking runs off the clock instead of delays so the host still gets answered in between
+uint32_t freddyAt = 0;
+uint32_t freddyWait = 0;
+bool freddyLast = false;
 
-microLed<stripsOrder, pins, stripCount, data> led;
+microLed<stripsOrder, strips, stripCount, data> led;
 
 void setup() {
     pinMode(relayPin, OUTPUT);
     digitalWrite(relayPin, LOW);
-    add_leds_at<0, data, strips, pins>();
+    led.begin();
     uart::begin();
     uart::write(1);
+}
+
+void show() {
+    // the bit-banging can't take an interrupt, anything past the two bytes the uart holds itself is lost meanwhile.
+    // the host only sends after the pong that comes after this and freddy waits for the line to be quiet, so only a
+    // message that starts during one of his blinks runs into that
     cli();
+    switch(dataBits) {
+        case 4: led.show<4>();
+            break;
+        case 8:
+            if constexpr (frameBits >= 8)
+                led.show<8>();
+            break;
+        default:
+            if constexpr (frameBits == 24)
+                led.show();
+            break;
+    }
+    // the uart can't say how many, only that it had to drop some
+    if(UCSR0A & (1 << DOR0))
+        uart::lost();
+    sei();
 }
 
-void showFreddy() {
-    size_t ledIndex = strips[0].size + strips[1].size / 3 / 2 * 3 - 10 * 3;
-    size_t ledIndex0 = ledIndex - 4 * 3;
-    size_t ledIndex1 = ledIndex + 4 * 3;
-    for(size_t i = 0; i < totalDataCount; i++)
+// all off, and when data can't hold plain colors a palette of off and freddy's eyes
+void clearLeds() {
+    for(size_t i = 0; i < dataSize; i++)
         data[i] = 0u;
-    data[ledIndex0] = freddyBrightness;
-    data[ledIndex0 + 1] = freddyBrightness;
-    data[ledIndex0 + 2] = freddyBrightness;
-    data[ledIndex1] = freddyBrightness;
-    data[ledIndex1 + 1] = freddyBrightness;
-    data[ledIndex1 + 2] = freddyBrightness;
-    led.show();
+    dataBits = frameBits;
+    if constexpr (frameBits != 24) {
+        uint8_t* eyes = &data[led.paletteOffset(frameBits) + 3];
+        eyes[0] = freddyBrightness;
+        eyes[1] = freddyBrightness;
+        eyes[2] = freddyBrightness;
+    }
+}
+
+void lightLed(size_t index) {
+    if constexpr (frameBits == 24) {
+        data[index * 3] = freddyBrightness;
+        data[index * 3 + 1] = freddyBrightness;
+        data[index * 3 + 2] = freddyBrightness;
+    }
+    else if constexpr (frameBits == 8) {
+        data[index] = 1;
+    }
+    else {
+        data[index / 2] |= index & 1 ? 0x10 : 0x01;
+    }
+}
+
+void showFreddy() {
+    size_t eyes = strips[0].size / 3 + strips[1].size / 3 / 2 - 10;
+    clearLeds();
+    lightLed(eyes - 4);
+    lightLed(eyes + 4);
+    show();
     freddyShown = true;
 }
 void hideFreddy() {
-    for(size_t i = 0; i < totalDataCount; i++)
-        data[i] = 0u;
-    led.show();
+    clearLeds();
+    show();
     freddyShown = false;
 }
 
-uint8_t readNext() {
-    while(!uart::canRead()) { }
-    return uart::read();
+// freddy fazbear mode har har har har har
+void updateFreddy() {
+    if(!freddy || micros() - freddyAt < freddyWait)
+        return;
+    // showing shuts the uart out, a blink can wait until whatever the host is sending is all in. a message that
+    // stopped halfway isn't coming anymore once the line was quiet for a while
+    bool receiving = (state != State::Type || frame != Frame::None) && millis() - lastByte <= huntingTimeoutMs;
+    if(uart::canRead() || receiving)
+        return;
+    if(freddyLast) {
+        freddy = false;
+        digitalWrite(relayPin, wasPowered ? HIGH : LOW);
+        return;
+    }
+    if(freddyShown)
+        hideFreddy();
+    else
+        showFreddy();
+    int waitTime = freddyShown ? rand() % 65 : rand() % 17;
+    freddyAt = micros();
+    freddyWait = 0;
+    for (int i = 0; i < waitTime; i++)
+        freddyWait += static_cast<unsigned int>(rand());
+    freddyLast = rand() % 100 == 0;
 }
 
-void readPower() {
-    auto value = readNext();
+void setPower(uint8_t value) {
     digitalWrite(relayPin, value == 0 ? LOW : HIGH);
     wasPowered = value != 0;
     freddy = value == 2;
     if(freddy) {
-        delayMicroseconds(65535u);
-        delayMicroseconds(65535u);
-        showFreddy();
+        // give the relay a moment
+        freddyShown = false;
+        freddyLast = false;
+        freddyAt = micros();
+        freddyWait = 2 * 65535ul;
     }
 }
 
-void readData() {
-    for(size_t i = 0; i < totalDataCount; i++)
-        data[i] = readNext();
-    pendingShow = true;
-}
-
 void readPing() {
     if(pendingShow)
-        led.show();
+        show();
     pendingShow = false;
     uart::write(0); // pong hehe
 }
 
-void loop() {
-    // freddy fazbear mode har har har har har
-    if(freddy) {
-        if(freddyShown)
-            hideFreddy();
-        else
-            showFreddy();
-        int waitTime = freddyShown ? rand() % 65 : rand() % 17;
-        for (int i = 0; i < waitTime; i++)
-            delayMicroseconds(rand());
-        if (rand() % 100 == 0) {
-            freddy = false;
-            digitalWrite(relayPin, wasPowered ? HIGH : LOW);
-        }
+void readCredits() {
+    // everything has to stop while the strips are written, so only ever one message in flight
+    sequenceKnown = false;
+    uart::write(static_cast<uint8_t>(ReplyType::Credits));
+    uart::write(0x80 | 1);
+}
+
+void reportDropped(uint8_t count) {
+    uart::write(static_cast<uint8_t>(ReplyType::Errors));
+    uart::write(0x80 | (count < 0x7f ? count : 0x7f));
+}
+
+void reportLost() {
+    if(uart::rxLost == 0)
+        return;
+    cli();
+    uint8_t count = uart::rxLost;
+    uart::rxLost = 0;
+    sei();
+    uart::write(static_cast<uint8_t>(ReplyType::Lost));
+    uart::write(0x80 | (count < 0x7f ? count : 0x7f));
+}
+
+void endMessage() {
+    state = frame == Frame::Payload ? State::Skip : State::Type;
+    headerSize = 0;
+}
+
+void endSpans() {
+    // the host never sends spans on top of an indexed frame
+    if constexpr (frameBits == 24) {
+        dataBits = 24;
+        pendingShow = true;
+    }
+    endMessage();
+}
+
+void endSpan() {
+    if(--spansLeft == 0) {
+        endSpans();
+        return;
+    }
+    state = State::SpanHeader;
+    headerSize = 0;
+}
+
+void startFrame() {
+    frameCounts = !hunting;
+    hunting = false;
+    frame = Frame::Header;
+    frameCrc = 0xffff;
+    framedPower = false;
+    headerSize = 0;
+}
+
+void rejectFrame() {
+    frame = Frame::None;
+    state = State::Type;
+    headerSize = 0;
+    pendingShow = false;
+    hunting = true;
+    if(frameCounts) {
+        nextSequence++;
+        reportDropped(1);
+    }
+}
+
+void endFrame() {
+    uint16_t check = header[0] | (header[1] << 8);
+    // a payload that ended before its message did is as broken as a bad crc
+    if(check != frameCrc || state != State::Skip) {
+        rejectFrame();
+        return;
+    }
+    frame = Frame::None;
+    state = State::Type;
+    headerSize = 0;
+
+    // anything the sequence skipped got lost entirely, marker and all
+    uint8_t missed = frameSequence - nextSequence;
+    if(sequenceKnown && missed > 0 && missed < 0x80)
+        reportDropped(missed);
+    sequenceKnown = true;
+    nextSequence = frameSequence + 1;
+
+    if(framedPower)
+        setPower(framedPowerValue);
+    readPing();
+}
+
+void readType(DataType type) {
+    bool inFrame = frame == Frame::Payload;
+    switch(type) {
+        case DataType::Power: state = State::Power;
+            break;
+        case DataType::Data: state = State::Data;
+            cursor = 0;
+            cursorEnd = totalDataCount;
+            break;
+        case DataType::Spans: state = State::SpanCount;
+            break;
+        case DataType::Indexed: state = State::IndexedHeader;
+            break;
+        // a frame gets its pong at the end and can't hold these
+        case DataType::Ping:
+            if(!inFrame)
+                readPing();
+            endMessage();
+            break;
+        case DataType::Credits:
+            if(!inFrame)
+                readCredits();
+            endMessage();
+            break;
+        case DataType::Framed:
+            if(inFrame)
+                endMessage();
+            else
+                startFrame();
+            break;
+        default: endMessage();
+            break;
+    }
+}
+
+void readMessage(uint8_t x) {
+    switch(state) {
+        case State::Type: readType(static_cast<DataType>(x));
+            break;
+        case State::Power:
+            if(frame == Frame::Payload) {
+                framedPower = true;
+                framedPowerValue = x;
+            }
+            else {
+                setPower(x);
+            }
+            endMessage();
+            break;
+        case State::Data:
+            if constexpr (frameBits == 24)
+                data[cursor] = x;
+            if(++cursor < cursorEnd)
+                break;
+            if constexpr (frameBits == 24) {
+                dataBits = 24;
+                pendingShow = true;
+            }
+            endMessage();
+            break;
+        case State::SpanCount:
+            header[headerSize++] = x;
+            if(headerSize < 2)
+                break;
+            spansLeft = header[0] | (header[1] << 8);
+            headerSize = 0;
+            state = State::SpanHeader;
+            if(spansLeft == 0)
+                endSpans();
+            break;
+        case State::SpanHeader:
+            header[headerSize++] = x;
+            if(headerSize < 4)
+                break;
+            cursor = static_cast<size_t>(header[0] | (header[1] << 8)) * 3;
+            cursorEnd = cursor + static_cast<size_t>(header[2] | (header[3] << 8)) * 3;
+            state = State::SpanData;
+            if(cursor == cursorEnd)
+                endSpan();
+            break;
+        case State::SpanData:
+            if(frameBits == 24 && cursor < totalDataCount)
+                data[cursor] = x;
+            if(++cursor == cursorEnd)
+                endSpan();
+            break;
+        case State::IndexedHeader:
+            header[headerSize++] = x;
+            if(headerSize < 2)
+                break;
+            indexedBits = header[0];
+            if(indexedBits != 4 && indexedBits != 8) {
+                endMessage();
+                break;
+            }
+            cursor = led.paletteOffset(indexedBits);
+            cursorEnd = cursor + (static_cast<size_t>(header[1]) + 1) * 3;
+            // a palette that doesn't fit leaves indices pointing past it, the indices might not fit either then
+            paletteFits = cursorEnd <= dataSize;
+            state = State::IndexedPalette;
+            break;
+        case State::IndexedPalette:
+            if(paletteFits)
+                data[cursor] = x;
+            if(++cursor < cursorEnd)
+                break;
+            cursor = 0;
+            cursorEnd = led.paletteOffset(indexedBits);
+            state = State::IndexedData;
+            break;
+        case State::IndexedData:
+            if(paletteFits)
+                data[cursor] = x;
+            if(++cursor < cursorEnd)
+                break;
+            if(paletteFits) {
+                dataBits = indexedBits;
+                pendingShow = true;
+            }
+            endMessage();
+            break;
+        case State::Skip:
+            break;
     }
+}
 
-    if(!uart::canRead())
+void readByte(uint8_t x) {
+    switch(frame) {
+        case Frame::Header:
+            frameCrc = _crc_xmodem_update(frameCrc, x);
+            header[headerSize++] = x;
+            if(headerSize < 3)
+                return;
+            frameRemaining = header[0] | (header[1] << 8);
+            frameSequence = header[2];
+            if(frameRemaining == 0 || frameRemaining > maxFrameSize) {
+                rejectFrame();
+                return;
+            }
+            frame = Frame::Payload;
+            state = State::Type;
+            headerSize = 0;
+            return;
+        case Frame::Payload:
+            frameCrc = _crc_xmodem_update(frameCrc, x);
+            readMessage(x);
+            if(--frameRemaining > 0)
+                return;
+            frame = Frame::Crc;
+            headerSize = 0;
+            return;
+        case Frame::Crc:
+            header[headerSize++] = x;
+            if(headerSize == 2)
+                endFrame();
+            return;
+        case Frame::None:
+            break;
+    }
+    if(hunting && static_cast<DataType>(x) != DataType::Framed)
         return;
-    switch(static_cast<DataType>(uart::read())) {
-        case DataType::Power: readPower();
+    readMessage(x);
+}
+
+// the bulk of every message is bytes going straight into data, those skip readByte's switches. the state machine still
+// gets the last byte of the message and of the frame so everything that happens at the end stays in one place
+bool copyBytes() {
+    if(frame != Frame::None && frame != Frame::Payload)
+        return false;
+    switch(state) {
+        case State::Data:
+            if constexpr (frameBits != 24)
+                return false;
             break;
-        case DataType::Data: readData();
+        case State::SpanData:
+            if(frameBits != 24 || cursorEnd > totalDataCount)
+                return false;
             break;
-        case DataType::Ping: readPing();
+        case State::IndexedPalette:
+        case State::IndexedData:
+            if(!paletteFits)
+                return false;
             break;
+        default:
+            return false;
+    }
+    size_t count = cursorEnd - cursor - 1;
+    if(frame == Frame::Payload && frameRemaining - 1u < count)
+        count = frameRemaining - 1u;
+    uint8_t available = uart::available();
+    if(available < count)
+        count = available;
+    if(count == 0)
+        return false;
+
+    uint8_t* out = &data[cursor];
+    cursor += count;
+    uint8_t tail = uart::rxTail;
+    if(frame == Frame::Payload) {
+        frameRemaining -= count;
+        uint16_t crc = frameCrc;
+        for(uint8_t i = static_cast<uint8_t>(count); i > 0; i--) {
+            uint8_t x = uart::rxBuffer[tail++];
+            *out++ = x;
+            crc = _crc_xmodem_update(crc, x);
+        }
+        frameCrc = crc;
+    }
+    else {
+        for(uint8_t i = static_cast<uint8_t>(count); i > 0; i--)
+            *out++ = uart::rxBuffer[tail++];
+    }
+    uart::rxTail = tail;
+    return true;
+}
+
+void loop() {
+    updateFreddy();
+
+    // the rest of a broken frame isn't coming, the host moved on
+    if(hunting && millis() - lastByte > huntingTimeoutMs)
+        hunting = false;
+    if(uart::canRead()) {
+        while(uart::canRead()) {
+            if(!copyBytes())
+                readByte(uart::read());
+        }
+        lastByte = millis();
     }
+    reportLost();
 }
@@ -2,21 +2,41 @@
 
 #include "Arduino.h"
 
-// buffers are for the weak
+// received bytes land in a ring from the rx interrupt, sending just waits for the data register
 namespace uart {
+    // a u8 index wraps around on its own
+    volatile uint8_t rxBuffer[256];
+    volatile uint8_t rxHead = 0;
+    volatile uint8_t rxTail = 0;
+    // bytes that never made it into the ring since the host was last told, stops at 255
+    volatile uint8_t rxLost = 0;
+
     void begin() {
         UBRR0 = 0;
         UCSR0A = (1 << U2X0);
-        UCSR0B = (1 << TXEN0) | (1 << RXEN0);
+        UCSR0B = (1 << TXEN0) | (1 << RXEN0) | (1 << RXCIE0);
         UCSR0C = (1 << UCSZ00) | (1 << UCSZ01);
     }
 
     inline bool canRead() {
-        return UCSR0A & (1 << RXC0);
+        return rxHead != rxTail;
+    }
+
+    inline uint8_t available() {
+        return rxHead - rxTail;
     }
 
     inline uint8_t read() {
-        return UDR0;
+        uint8_t tail = rxTail;
+        uint8_t x = rxBuffer[tail];
+        rxTail = tail + 1;
+        return x;
+    }
+
+    // with interrupts off
+    inline void lost() {
+        if(rxLost != 0xff)
+            rxLost++;
     }
 
     inline void write(uint8_t data) {
@@ -24,3 +44,16 @@ namespace uart {
         UDR0 = data;
     }
 };
+
+// a byte every 80 cycles at 2mbaud, keep this short. sim/ledsim.cpp reports how long it takes as rxLongest.
+// a full ring drops the byte and counts it, the host gets told from loop()
+ISR(USART_RX_vect) {
+    uint8_t x = UDR0;
+    uint8_t head = uart::rxHead;
+    if(static_cast<uint8_t>(head + 1) == uart::rxTail) {
+        uart::lost();
+        return;
+    }
+    uart::rxBuffer[head] = x;
+    uart::rxHead = head + 1;
+}
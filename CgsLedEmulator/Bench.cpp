@@ -0,0 +1,213 @@
+#include "Emulator.hpp"
+#include "CgsLedRgbController.hpp"
+#include <charconv>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <time.h>
+
+// pushes frames through the real plugin controller and serial_port into the emulator and reports what came out
+
+static double cpuSeconds(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [emulator options] [--seconds 5] [--rate 120] [--fps 60] [--compress 1]\n"
+        "       [--pattern static|chase|gradient|noise] [--interpolate off|linear|eased] [--interpolate-rate 0]\n"
+        "       [--delay 0] [--json 1]\n"
+        "--rate is how often the effect updates the leds, 0 for as fast as possible\n"
+        "emulator options are the same as CgsLedEmulator's\n",
+        name);
+}
+
+static bool parseUnsigned(std::string_view text, unsigned int& value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && error == std::errc() && end == text.data() + text.size();
+}
+
+// roughly what the effects plugin throws at us, from the best case for the encoders to the worst
+static void fillPattern(std::string_view pattern, std::vector<RGBColor>& colors, unsigned int frame, uint32_t& seed) {
+    const size_t count = colors.size();
+    for (size_t i = 0; i < count; i++) {
+        if (pattern == "static") {
+            colors[i] = ToRGBColor(255, 80, 0);
+        }
+        else if (pattern == "chase") {
+            bool lit = (i + frame) % 32 < 4;
+            colors[i] = lit ? ToRGBColor(0, 128, 255) : ToRGBColor(0, 0, 0);
+        }
+        else if (pattern == "gradient") {
+            unsigned int hue = static_cast<unsigned int>((i * 256 / count + frame) % 256);
+            colors[i] = ToRGBColor(hue, (255 - hue), ((hue * 2) % 256));
+        }
+        else {
+            seed = seed * 1664525u + 1013904223u;
+            colors[i] = seed >> 8;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    EmulatorConfig emulatorConfig;
+    unsigned int seconds = 5;
+    unsigned int rate = 120;
+    unsigned int fps = 60;
+    unsigned int compress = 1;
+    unsigned int json = 0;
+    std::string pattern = "gradient";
+    std::string interpolate = "off";
+    unsigned int interpolateRate = 0;
+    unsigned int delay = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string_view name = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++i];
+        bool ok;
+        if (name == "--seconds")
+            ok = parseUnsigned(value, seconds) && seconds > 0;
+        else if (name == "--rate")
+            ok = parseUnsigned(value, rate);
+        else if (name == "--fps")
+            ok = parseUnsigned(value, fps);
+        else if (name == "--compress")
+            ok = parseUnsigned(value, compress);
+        else if (name == "--interpolate") {
+            interpolate = value;
+            ok = interpolate == "off" || interpolate == "linear" || interpolate == "eased";
+        }
+        else if (name == "--interpolate-rate")
+            ok = parseUnsigned(value, interpolateRate);
+        else if (name == "--delay")
+            ok = parseUnsigned(value, delay);
+        else if (name == "--json")
+            ok = parseUnsigned(value, json);
+        else if (name == "--pattern") {
+            pattern = value;
+            ok = pattern == "static" || pattern == "chase" || pattern == "gradient" || pattern == "noise";
+        }
+        else
+            ok = Emulator::ParseOption(emulatorConfig, name, value);
+        if (!ok) {
+            fprintf(stderr, "bad option %s %s\n", name.data(), value.data());
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    try {
+        Emulator emulator(emulatorConfig);
+        std::thread firmware(&Emulator::Run, &emulator);
+
+        CgsLedConfig config;
+        config.port = emulator.Port();
+        config.baud = 12000000;
+        // full brightness without gamma packs colors unchanged so the device side can be checked byte for byte
+        config.brightness = 100;
+        config.compress = compress != 0;
+        config.indexed = false;
+        config.gamma = false;
+        config.fps = fps;
+        // the last fade still ends on the last frame, so the check below works either way
+        config.interpolate = interpolate == "linear" ? 1 : interpolate == "eased" ? 2 : 0;
+        config.interpolateRate = interpolateRate;
+        config.delayMs = delay;
+        for (size_t i = 0; i < emulatorConfig.strips.size(); i++)
+            config.zones.push_back({ "Strip " + std::to_string(i), static_cast<unsigned int>(emulatorConfig.strips[i]), ColorPacker::ParseOrder("GRB") });
+
+        auto* controller = new CgsLedRgbController(config);
+        controller->active_mode = 1;
+        controller->DeviceUpdateMode();
+
+        using clock = std::chrono::steady_clock;
+        const auto interval = rate > 0 ?
+            std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rate)) :
+            clock::duration::zero();
+        const double cpuStart = cpuSeconds(CLOCK_PROCESS_CPUTIME_ID);
+        const EmulatorStats emulatorStart = emulator.GetStats();
+        const auto start = clock::now();
+        const auto end = start + std::chrono::seconds(seconds);
+        double patternCpu = 0.0;
+        uint32_t seed = 1;
+        unsigned int frame = 0;
+        auto next = start;
+        while (clock::now() < end) {
+            // generating the pattern isn't the plugin's cost
+            double patternStart = cpuSeconds(CLOCK_THREAD_CPUTIME_ID);
+            fillPattern(pattern, controller->colors, frame++, seed);
+            patternCpu += cpuSeconds(CLOCK_THREAD_CPUTIME_ID) - patternStart;
+            controller->DeviceUpdateLEDs();
+            next += interval;
+            std::this_thread::sleep_until(next);
+        }
+        const auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        const EmulatorStats emulatorEnd = emulator.GetStats();
+        const double cpu = cpuSeconds(CLOCK_PROCESS_CPUTIME_ID) - cpuStart - patternCpu -
+            (emulatorEnd.cpuSeconds - emulatorStart.cpuSeconds);
+
+        // the last frame has to make it to the strips exactly as packed
+        std::vector<uint8_t> expected(controller->colors.size() * 3);
+        for (size_t i = 0; i < controller->colors.size(); i++) {
+            expected[i * 3] = RGBGetGValue(controller->colors[i]);
+            expected[i * 3 + 1] = RGBGetRValue(controller->colors[i]);
+            expected[i * 3 + 2] = RGBGetBValue(controller->colors[i]);
+        }
+        bool match = false;
+        for (auto deadline = clock::now() + std::chrono::seconds(2); !match && clock::now() < deadline;) {
+            match = emulator.Snapshot() == expected;
+            if (!match)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        CgsLedStats stats = controller->GetStats();
+        delete controller;
+        emulator.Stop();
+        firmware.join();
+
+        const double shown = static_cast<double>(emulatorEnd.frames - emulatorStart.frames);
+        const double p50 = LatencyHistogram::Percentile(stats.latency, 0.5) * 1e3;
+        const double p90 = LatencyHistogram::Percentile(stats.latency, 0.9) * 1e3;
+        const double p99 = LatencyHistogram::Percentile(stats.latency, 0.99) * 1e3;
+        const double cpuPerFrame = stats.sent > 0 ? cpu / static_cast<double>(stats.sent) * 1e6 : 0.0;
+        const double bytesPerFrame = stats.sent > 0 ? static_cast<double>(stats.bytes) / static_cast<double>(stats.sent) : 0.0;
+        const char* format = json ?
+            "{\"pattern\":\"%s\",\"fps\":%.2f,\"requested\":%llu,\"sent\":%llu,\"coalesced\":%llu,\"bytesPerFrame\":%.1f,"
+            "\"latencyP50Ms\":%.3f,\"latencyP90Ms\":%.3f,\"latencyP99Ms\":%.3f,\"cpuPerFrameUs\":%.2f,\"credits\":%zu,"
+            "\"droppedBytes\":%llu,\"errors\":%llu,\"late\":%llu,\"early\":%llu,\"clockErrorUs\":%lld,\"match\":%s}\n" :
+            "pattern        %s\n"
+            "fps            %.2f\n"
+            "requested      %llu\n"
+            "sent           %llu\n"
+            "coalesced      %llu\n"
+            "bytes/frame    %.1f\n"
+            "latency p50    %.3f ms\n"
+            "latency p90    %.3f ms\n"
+            "latency p99    %.3f ms\n"
+            "cpu/frame      %.2f us\n"
+            "credits        %zu\n"
+            "dropped bytes  %llu\n"
+            "errors         %llu\n"
+            "late/early     %llu/%llu\n"
+            "clock error    %lld us\n"
+            "match          %s\n";
+        printf(format, pattern.c_str(), shown / elapsed,
+            static_cast<unsigned long long>(stats.requested), static_cast<unsigned long long>(stats.sent),
+            static_cast<unsigned long long>(stats.coalesced), bytesPerFrame, p50, p90, p99, cpuPerFrame, stats.credits,
+            static_cast<unsigned long long>(emulatorEnd.dropped), static_cast<unsigned long long>(stats.errors),
+            static_cast<unsigned long long>(stats.late), static_cast<unsigned long long>(stats.early),
+            static_cast<long long>(stats.clockErrorUs), match ? "true" : "false");
+        return match ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
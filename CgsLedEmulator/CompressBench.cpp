@@ -0,0 +1,180 @@
+#include "Compressor.hpp"
+#include "protocol.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// the plugin's compressed frames through the firmware's decoding for a bunch of frames that hit every kind of run
+// and both palette cases, and its indexed frames the way the nano stores and looks them up, then how long encoding
+// one of the pico's frames takes. fails if anything comes back different or the decoder doesn't end right where
+// the message does
+
+namespace {
+    struct BufferSource {
+        const uint8_t* at;
+        const uint8_t* end;
+
+        uint8_t next() {
+            return at < end ? *at++ : 0;
+        }
+
+        void into(uint8_t* current, size_t remaining) {
+            for (; remaining > 0; remaining--)
+                *current++ = next();
+        }
+    };
+
+    uint32_t seed = 1;
+    uint8_t random8() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<uint8_t>(seed >> 24);
+    }
+
+    struct Pattern {
+        const char* name;
+        void (*fill)(std::vector<char>& frame, size_t led);
+    };
+
+    void setLed(std::vector<char>& frame, size_t led, uint32_t color) {
+        frame[led * 3] = static_cast<char>(color >> 16);
+        frame[led * 3 + 1] = static_cast<char>(color >> 8);
+        frame[led * 3 + 2] = static_cast<char>(color);
+    }
+
+    const Pattern patterns[] = {
+        { "off", [](std::vector<char>& frame, size_t led) { setLed(frame, led, 0); } },
+        { "chase", [](std::vector<char>& frame, size_t led) { setLed(frame, led, led % 20 < 3 ? 0xff8000 : 0); } },
+        // runs right at and around the 128 a header can hold
+        { "long runs", [](std::vector<char>& frame, size_t led) { setLed(frame, led, (led / 129) * 0x010203); } },
+        { "few colors", [](std::vector<char>& frame, size_t led) { setLed(frame, led, random8() % 5 * 0x203040); } },
+        // a full palette, and too many colors for one so the runs carry the colors themselves
+        { "256 colors", [](std::vector<char>& frame, size_t led) { setLed(frame, led, led / 4 % 256 * 0x010101); } },
+        { "steps", [](std::vector<char>& frame, size_t led) { setLed(frame, led, led / 2 * 0x000103); } },
+        { "noise", [](std::vector<char>& frame, size_t led) {
+            setLed(frame, led, (random8() << 16) | (random8() << 8) | random8());
+        } },
+    };
+
+    // false if the frame doesn't come back or the decoder stops anywhere but the end
+    bool roundTrip(Compressor& compressor, const std::vector<char>& frame, size_t& encoded) {
+        std::vector<char> message(frame.size());
+        encoded = compressor.Encode(frame.data(), frame.size(), message.data());
+        if (encoded == 0)
+            return true;
+        std::vector<uint8_t> data(frame.size());
+        std::vector<uint8_t> palette(256 * 3);
+        BufferSource source { reinterpret_cast<const uint8_t*>(message.data()),
+            reinterpret_cast<const uint8_t*>(message.data()) + encoded };
+        protocol::readCompressed(source, data.data(), data.size(), palette.data());
+        return source.at == source.end && memcmp(data.data(), frame.data(), frame.size()) == 0;
+    }
+
+    // the nano's State::Indexed* put the indices at the start of its frame buffer and the palette right behind them,
+    // then microLed::color looks every led up from there
+    bool indexedRoundTrip(Compressor& compressor, const std::vector<char>& frame, size_t& encoded) {
+        std::vector<char> message(frame.size() + 2);
+        encoded = compressor.EncodeIndexed(frame.data(), frame.size(), message.data());
+        if (encoded == 0)
+            return true;
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(message.data());
+        const size_t ledCount = frame.size() / 3;
+        const uint8_t bits = in[0];
+        const size_t paletteOffset = bits == 4 ? (ledCount + 1) / 2 : ledCount;
+        const size_t paletteSize = (in[1] + 1) * 3;
+        if ((bits != 4 && bits != 8) || paletteOffset + paletteSize > frame.size() ||
+            2 + paletteSize + paletteOffset != encoded)
+            return false;
+        std::vector<uint8_t> data(frame.size());
+        memcpy(&data[paletteOffset], &in[2], paletteSize);
+        memcpy(&data[0], &in[2 + paletteSize], paletteOffset);
+        for (size_t led = 0; led < ledCount; led++) {
+            uint8_t index = bits == 8 ? data[led] : led & 1 ? data[led / 2] >> 4 : data[led / 2] & 0x0f;
+            if (index * 3u + 3 > paletteSize || memcmp(&data[paletteOffset + index * 3], &frame[led * 3], 3) != 0)
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned int frames = argc > 1 ? static_cast<unsigned int>(strtoul(argv[1], nullptr, 10)) : 20000;
+    if (frames == 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 2;
+    }
+
+    int failures = 0;
+    Compressor compressor;
+    for (const auto& pattern : patterns) {
+        size_t checked = 0;
+        size_t raw = 0;
+        size_t indexed = 0;
+        size_t wrong = 0;
+        for (size_t ledCount : { 1, 2, 3, 127, 128, 129, 130, 256, 257, 289, 1000 }) {
+            std::vector<char> frame(ledCount * 3);
+            for (size_t led = 0; led < ledCount; led++)
+                pattern.fill(frame, led);
+            size_t encoded;
+            if (!roundTrip(compressor, frame, encoded))
+                wrong++;
+            if (encoded == 0)
+                raw++;
+            if (!indexedRoundTrip(compressor, frame, encoded))
+                wrong++;
+            if (encoded != 0)
+                indexed++;
+            checked++;
+        }
+        printf("%-12s %zu frames, %zu went raw, %zu indexed, %zu wrong\n", pattern.name, checked, raw, indexed, wrong);
+        if (wrong > 0)
+            failures++;
+    }
+
+    // more colors than an index reaches, the ones past 256 have to be skipped and not read as runs
+    {
+        std::vector<uint8_t> message;
+        message.push_back(300 & 0xff);
+        message.push_back(300 >> 8);
+        for (size_t i = 0; i < 300; i++) {
+            message.push_back(static_cast<uint8_t>(i));
+            message.push_back(static_cast<uint8_t>(i >> 8));
+            message.push_back(0x55);
+        }
+        message.push_back(0x80 | 9);
+        message.push_back(5);
+        std::vector<uint8_t> data(10 * 3);
+        std::vector<uint8_t> palette(256 * 3);
+        BufferSource source { message.data(), message.data() + message.size() };
+        protocol::readCompressed(source, data.data(), data.size(), palette.data());
+        bool ok = source.at == source.end;
+        for (size_t led = 0; led < 10; led++)
+            ok = ok && data[led * 3] == 5 && data[led * 3 + 1] == 0 && data[led * 3 + 2] == 0x55;
+        printf("%-12s %s\n", "big palette", ok ? "skipped" : "out of step");
+        if (!ok)
+            failures++;
+    }
+
+    // the pico's strips, what the writer thread does for every frame with compression on
+    const size_t ledCount = 177 + 82 + 30;
+    std::vector<char> frame(ledCount * 3);
+    std::vector<char> message(frame.size());
+    compressor.Reserve(ledCount);
+    size_t checksum = 0;
+    for (const auto& pattern : patterns) {
+        for (size_t led = 0; led < ledCount; led++)
+            pattern.fill(frame, led);
+        size_t encoded = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < frames; i++) {
+            encoded = compressor.Encode(frame.data(), frame.size(), message.data());
+            checksum += encoded;
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+        printf("%-12s %.2f us/frame, %zu of %zu bytes\n", pattern.name, us, encoded == 0 ? frame.size() : encoded,
+            frame.size());
+    }
+    // keeps the encoding from being optimized out
+    return failures > 0 || checksum == SIZE_MAX ? 1 : 0;
+}
@@ -0,0 +1,574 @@
+#include "Emulator.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+using protocol::DataType;
+using protocol::ReplyType;
+
+// what a usb full speed bulk packet carries, bytes arrive on the device in chunks this big
+constexpr size_t usbPacketSize = 64;
+
+constexpr auto huntingTimeout = std::chrono::milliseconds(50);
+// same as the pico, a frame whose length got mangled stops reading after this
+constexpr auto frameTimeout = std::chrono::milliseconds(20);
+constexpr auto maxFade = std::chrono::milliseconds(100);
+// same as the pico, which holds timed frames in the 4 of its 6 outputs that aren't going out
+constexpr int32_t maxLeadUs = 250000;
+constexpr size_t heldFrames = 4;
+
+// thrown out of the blocking reads to unwind the firmware loop on Stop()
+struct EmulatorStopped { };
+
+static double threadCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+template<typename T>
+static bool parseNumber(std::string_view text, T& value) {
+    if (text.empty())
+        return false;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+bool Emulator::ParseOption(EmulatorConfig& config, std::string_view name, std::string_view value) {
+    if (name == "--strips") {
+        std::vector<size_t> strips;
+        while (!value.empty()) {
+            size_t comma = std::min(value.find(','), value.size());
+            size_t leds;
+            if (!parseNumber(value.substr(0, comma), leds) || leds == 0)
+                return false;
+            strips.push_back(leds);
+            value.remove_prefix(std::min(comma + 1, value.size()));
+        }
+        if (strips.empty())
+            return false;
+        config.strips = strips;
+        return true;
+    }
+    if (name == "--bandwidth") {
+        // from_chars for doubles needs a newer libstdc++ than some distros ship
+        uint64_t bytesPerSecond;
+        if (!parseNumber(value, bytesPerSecond))
+            return false;
+        config.bytesPerSecond = static_cast<double>(bytesPerSecond);
+        return true;
+    }
+    if (name == "--latency") {
+        uint32_t us;
+        if (!parseNumber(value, us))
+            return false;
+        config.latency = std::chrono::microseconds(us);
+        return true;
+    }
+    if (name == "--led-time") {
+        uint32_t ns;
+        if (!parseNumber(value, ns))
+            return false;
+        config.ledTime = std::chrono::nanoseconds(ns);
+        return true;
+    }
+    if (name == "--drop-every")
+        return parseNumber(value, config.dropEvery);
+    if (name == "--rx-queue")
+        return parseNumber(value, config.rxQueueSize) && config.rxQueueSize >= usbPacketSize;
+    return false;
+}
+
+Emulator::Emulator(const EmulatorConfig& config) : m_config(config) {
+    m_totalDataCount = 0;
+    m_longestStrip = 0;
+    for (size_t strip : m_config.strips) {
+        m_totalDataCount += strip * 3;
+        m_longestStrip = std::max(m_longestStrip, strip);
+    }
+    m_frameCredits = static_cast<uint8_t>(std::clamp<size_t>(m_config.rxQueueSize / (1 + m_totalDataCount + 1), 1, 0x7f));
+    m_rxQueue.resize(m_config.rxQueueSize);
+    m_data.resize(m_totalDataCount);
+    m_frame.resize(protocol::maxFrameSize(m_totalDataCount));
+    m_shown.resize(m_totalDataCount);
+    m_fadeFrom.resize(m_totalDataCount);
+    m_faded.resize(m_totalDataCount);
+    m_epoch = clock::now();
+
+    auto fail = [&](const char* what) {
+        int error = errno;
+        if (m_slave >= 0)
+            close(m_slave);
+        if (m_master >= 0)
+            close(m_master);
+        throw std::system_error(error, std::generic_category(), what);
+    };
+
+    m_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m_master < 0)
+        fail("posix_openpt");
+    if (grantpt(m_master) != 0 || unlockpt(m_master) != 0)
+        fail("unlockpt");
+    const char* name = ptsname(m_master);
+    if (!name)
+        fail("ptsname");
+    m_port = name;
+
+    // raw right away, otherwise the line discipline echoes the pongs back at us until the host configures the port
+    m_slave = open(m_port.c_str(), O_RDWR | O_NOCTTY);
+    if (m_slave < 0)
+        fail("open");
+    termios tio;
+    if (tcgetattr(m_slave, &tio) != 0)
+        fail("tcgetattr");
+    cfmakeraw(&tio);
+    if (tcsetattr(m_slave, TCSANOW, &tio) != 0)
+        fail("tcsetattr");
+    if (fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK) != 0)
+        fail("fcntl");
+}
+
+Emulator::~Emulator() {
+    close(m_slave);
+    close(m_master);
+}
+
+EmulatorStats Emulator::GetStats() const {
+    return { m_bytes, m_frames, m_fades, m_pings, m_powerChanges, m_dropped, m_rejected, m_late, m_early, m_cpuSeconds };
+}
+
+std::vector<uint8_t> Emulator::Snapshot() const {
+    std::lock_guard lock(m_shownMutex);
+    return m_shown;
+}
+
+void Emulator::Poll() {
+    auto now = clock::now();
+    while (m_rxTail - m_rxHead < m_rxQueue.size()) {
+        size_t index = m_rxTail % m_rxQueue.size();
+        size_t space = std::min(m_rxQueue.size() - (m_rxTail - m_rxHead), m_rxQueue.size() - index);
+        // EAGAIN when there's nothing, EIO while nobody has the port open
+        ssize_t res = read(m_master, &m_rxQueue[index], space);
+        if (res <= 0)
+            break;
+        m_bytes += res;
+
+        if (m_config.dropEvery > 0) {
+            size_t kept = 0;
+            for (ssize_t i = 0; i < res; i++) {
+                if (++m_dropCounter == m_config.dropEvery) {
+                    m_dropCounter = 0;
+                    m_dropped++;
+                    continue;
+                }
+                m_rxQueue[index + kept++] = m_rxQueue[index + i];
+            }
+            res = static_cast<ssize_t>(kept);
+        }
+
+        for (size_t off = 0; off < static_cast<size_t>(res); off += usbPacketSize) {
+            size_t size = std::min(usbPacketSize, static_cast<size_t>(res) - off);
+            m_linkFree = std::max(m_linkFree, now);
+            if (m_config.bytesPerSecond > 0.0)
+                m_linkFree += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(size / m_config.bytesPerSecond));
+            m_packets.push_back({ m_linkFree + m_config.latency, m_rxTail + off + size });
+        }
+        m_rxTail += res;
+    }
+
+    while (!m_packets.empty() && m_packets.front().at <= now) {
+        m_rxReady = m_packets.front().end;
+        m_packets.pop_front();
+    }
+}
+
+void Emulator::Idle(clock::time_point until) {
+    if (m_stopping)
+        throw EmulatorStopped();
+
+    // never sleep for long so Stop() gets noticed
+    auto now = clock::now();
+    until = std::min(until, now + std::chrono::milliseconds(5));
+    if (!m_packets.empty())
+        until = std::min(until, m_packets.front().at);
+    if (until <= now)
+        return;
+
+    auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(until - now);
+    timespec timeout { static_cast<time_t>(wait.count() / 1000000000), static_cast<long>(wait.count() % 1000000000) };
+    // a full queue has to drain first, waiting for input would just spin
+    pollfd fd { m_master, static_cast<short>(m_rxTail - m_rxHead < m_rxQueue.size() ? POLLIN : 0), 0 };
+    ppoll(&fd, 1, &timeout, nullptr);
+    // POLLHUP while the host has the port closed makes ppoll return right away
+    if (fd.revents & POLLHUP)
+        nanosleep(&timeout, nullptr);
+}
+
+bool Emulator::TryRead(uint8_t& x) {
+    if (m_rxHead == m_rxReady)
+        Poll();
+    if (m_rxHead == m_rxReady)
+        return false;
+    x = m_rxQueue[m_rxHead++ % m_rxQueue.size()];
+    return true;
+}
+
+uint8_t Emulator::ReadNext() {
+    if (m_frameCursor)
+        return m_frameCursor < m_frameEnd ? *m_frameCursor++ : 0;
+    uint8_t b;
+    while (!TryRead(b))
+        Idle(clock::time_point::max());
+    return b;
+}
+
+bool Emulator::ReadLink(uint8_t* current, size_t remaining, clock::time_point deadline) {
+    while (remaining > 0) {
+        if (m_rxHead == m_rxReady) {
+            Poll();
+            if (m_rxHead == m_rxReady) {
+                if (clock::now() >= deadline)
+                    return false;
+                Idle(deadline);
+            }
+            continue;
+        }
+        size_t index = m_rxHead % m_rxQueue.size();
+        size_t count = std::min({ remaining, m_rxReady - m_rxHead, m_rxQueue.size() - index });
+        memcpy(current, &m_rxQueue[index], count);
+        m_rxHead += count;
+        current += count;
+        remaining -= count;
+    }
+    return true;
+}
+
+void Emulator::ReadInto(uint8_t* current, size_t remaining) {
+    if (m_frameCursor) {
+        size_t count = std::min<size_t>(remaining, m_frameEnd - m_frameCursor);
+        memcpy(current, m_frameCursor, count);
+        memset(current + count, 0, remaining - count);
+        m_frameCursor += count;
+        return;
+    }
+    ReadLink(current, remaining, clock::time_point::max());
+}
+
+void Emulator::Write(uint8_t x) {
+    // replies are dropped while nobody has the port open, same as the pico's cdc
+    (void)!write(m_master, &x, 1);
+}
+
+void Emulator::WritePong() {
+    const auto late = static_cast<uint32_t>(std::min<uint64_t>(m_late - m_reportedLate, protocol::maxReplyCount));
+    const auto early = static_cast<uint32_t>(std::min<uint64_t>(m_early - m_reportedEarly, protocol::maxReplyCount));
+    m_reportedLate += late;
+    m_reportedEarly += early;
+    uint8_t reply[protocol::maxPongSize];
+    (void)!write(m_master, reply, protocol::writePong(reply, DeviceTime(), late, early));
+    m_pings++;
+}
+
+uint32_t Emulator::DeviceTime() const {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - m_epoch).count());
+}
+
+void Emulator::WaitForOutput() {
+    const auto freeAt = m_outputsFreeAt[m_nextOutput];
+    while (clock::now() < freeAt) {
+        Poll();
+        Idle(freeAt);
+    }
+}
+
+void Emulator::ShowAll() {
+    Show(m_data.data());
+}
+
+void Emulator::Show(const uint8_t* frame) {
+    // the pico queues frames behind the one going out and hands an output back once the strips' dma has read it,
+    // so the usb core only waits when every output is queued or going out
+    WaitForOutput();
+    {
+        std::lock_guard lock(m_shownMutex);
+        memcpy(m_shown.data(), frame, m_totalDataCount);
+    }
+    // all strips go out in parallel, the longest one decides when the next frame can start
+    auto start = std::max(clock::now(), m_stripsBusyUntil);
+    auto end = start + m_config.ledTime * m_longestStrip;
+    m_outputsFreeAt[m_nextOutput] = end;
+    m_nextOutput = (m_nextOutput + 1) % m_outputsFreeAt.size();
+    m_stripsBusyUntil = end + m_config.latchTime;
+}
+
+void Emulator::SetPower(uint8_t value) {
+    // the relay and freddy's speaker aren't emulated, just the strips being cleared
+    m_powered = value > 0;
+    m_powerChanges++;
+    if (!m_powered) {
+        m_effect = effects::Params();
+        m_fading = false;
+        m_held.clear();
+        std::fill(m_data.begin(), m_data.end(), 0);
+        ShowAll();
+    }
+}
+
+void Emulator::ReadPower() {
+    SetPower(ReadNext());
+}
+
+void Emulator::ShowReceived() {
+    const auto now = clock::now();
+    const auto since = now - m_lastReceived;
+    m_lastReceived = now;
+    if (since < maxFade)
+        m_frameInterval = (m_frameInterval * 3 + std::chrono::duration_cast<std::chrono::microseconds>(since)) / 4;
+    m_frames++;
+    if (m_timed) {
+        m_fading = false;
+        const int32_t ahead = static_cast<int32_t>(m_dueUs - DeviceTime());
+        if (ahead <= 0 || ahead > maxLeadUs) {
+            if (ahead <= 0)
+                m_late++;
+            else
+                m_early++;
+            ShowAll();
+            return;
+        }
+        // every output's taken, the usb core waits for one like the pico does
+        while (m_held.size() >= heldFrames) {
+            if (clock::now() >= m_held.front().due)
+                ShowHeld();
+            else
+                Idle(m_held.front().due);
+        }
+        const auto due = now + std::chrono::microseconds(ahead);
+        auto at = std::find_if(m_held.begin(), m_held.end(), [&](const Held& x) { return x.due > due; });
+        m_held.insert(at, { due, m_data });
+        return;
+    }
+    if (m_interpolation.curve == blend::Curve::None) {
+        ShowAll();
+        return;
+    }
+    {
+        std::lock_guard lock(m_shownMutex);
+        m_fadeFrom = m_shown;
+    }
+    m_fadeStart = now;
+    m_nextFade = now;
+    m_fading = true;
+}
+
+void Emulator::ReadData() {
+    ReadInto(m_data.data(), m_totalDataCount);
+    ShowReceived();
+}
+
+void Emulator::ReadEffect() {
+    uint8_t params[effects::paramsSize];
+    ReadInto(params, effects::paramsSize);
+    m_effect = effects::parse(params);
+    m_effectStart = clock::now();
+}
+
+void Emulator::ShowHeld() {
+    Held held = std::move(m_held.front());
+    m_held.pop_front();
+    Show(held.frame.data());
+}
+
+void Emulator::ReadTimed() {
+    Source source { *this };
+    m_dueUs = protocol::next32(source);
+    m_timed = true;
+    switch (static_cast<DataType>(ReadNext())) {
+        case DataType::Data: ReadData();
+            break;
+        case DataType::Spans: ReadSpans();
+            break;
+        case DataType::Compressed: ReadCompressed();
+            break;
+        default:
+            break;
+    }
+    m_timed = false;
+}
+
+void Emulator::ReadInterpolate() {
+    uint8_t params[blend::paramsSize];
+    ReadInto(params, blend::paramsSize);
+    m_interpolation = blend::parse(params);
+    if (m_fading)
+        ShowAll();
+    m_fading = false;
+}
+
+void Emulator::DrawFade() {
+    const auto now = clock::now();
+    const auto elapsed = now - m_fadeStart;
+    const uint16_t progress = elapsed >= m_frameInterval ? 256 : static_cast<uint16_t>(elapsed * 256 / m_frameInterval);
+    blend::mix(m_fadeFrom.data(), m_data.data(), m_faded.data(), m_totalDataCount,
+        blend::shape(m_interpolation.curve, progress), m_interpolation.linearLight);
+    Show(m_faded.data());
+    m_fades++;
+    m_fading = progress < 256;
+    if (m_interpolation.rate > 0)
+        m_nextFade = now + std::chrono::microseconds(1000000 / m_interpolation.rate);
+}
+
+void Emulator::DrawEffect() {
+    const uint32_t ms = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - m_effectStart).count());
+    effects::render(m_effect, ms, m_config.strips.data(), m_config.strips.size(), m_data.data());
+    m_fading = false;
+    ShowAll();
+    m_frames++;
+}
+
+void Emulator::ReadSpans() {
+    Source source { *this };
+    protocol::readSpans(source, m_data.data(), m_totalDataCount);
+    ShowReceived();
+}
+
+void Emulator::ReadCompressed() {
+    Source source { *this };
+    protocol::readCompressed(source, m_data.data(), m_totalDataCount, m_palette.data());
+    ShowReceived();
+}
+
+void Emulator::ReadCredits() {
+    m_sequence.known = false;
+    Write(static_cast<uint8_t>(ReplyType::Credits));
+    Write(0x80 | m_frameCredits);
+}
+
+void Emulator::ReadPing() {
+    WritePong();
+}
+
+void Emulator::ReportDropped(uint8_t count) {
+    Write(static_cast<uint8_t>(ReplyType::Errors));
+    Write(0x80 | std::min<uint8_t>(count, 0x7f));
+}
+
+void Emulator::ReadFramed() {
+    bool reject = !m_hunting;
+    m_hunting = false;
+
+    const auto deadline = clock::now() + frameTimeout;
+    uint8_t header[protocol::frameHeaderSize];
+    bool valid = ReadLink(header, protocol::frameHeaderSize, deadline);
+    size_t size = header[0] | (header[1] << 8);
+    uint8_t sequence = header[2];
+    valid = valid && size > 0 && size <= m_frame.size();
+    if (valid) {
+        uint8_t check[protocol::frameCrcSize];
+        valid = ReadLink(m_frame.data(), size, deadline) && ReadLink(check, protocol::frameCrcSize, deadline) &&
+            protocol::frameValid(header, m_frame.data(), size, check);
+    }
+    if (!valid) {
+        m_hunting = true;
+        if (reject) {
+            m_sequence.skip();
+            m_rejected++;
+            ReportDropped(1);
+        }
+        return;
+    }
+
+    if (uint8_t missed = m_sequence.received(sequence)) {
+        m_rejected += missed;
+        ReportDropped(missed);
+    }
+
+    m_frameCursor = &m_frame[1];
+    m_frameEnd = &m_frame[size];
+    switch (static_cast<DataType>(m_frame[0])) {
+        case DataType::Power: ReadPower();
+            break;
+        case DataType::Data: ReadData();
+            break;
+        case DataType::Spans: ReadSpans();
+            break;
+        case DataType::Compressed: ReadCompressed();
+            break;
+        case DataType::Effect: ReadEffect();
+            break;
+        case DataType::Interpolate: ReadInterpolate();
+            break;
+        case DataType::Timed: ReadTimed();
+            break;
+        default:
+            break;
+    }
+    m_frameCursor = nullptr;
+    WritePong();
+}
+
+void Emulator::Run() {
+    try {
+        SetPower(0);
+        while (!m_stopping) {
+            uint8_t x;
+            if (!TryRead(x)) {
+                if (m_hunting && clock::now() - m_lastByte > huntingTimeout)
+                    m_hunting = false;
+                // held frames go out on the dot, the effect and the fades only ever take an output that's already free
+                const bool effect = m_effect.effect != effects::Effect::None;
+                const auto due = m_held.empty() ? clock::time_point::max() : m_held.front().due;
+                if (clock::now() >= due)
+                    ShowHeld();
+                else if (!effect && !m_fading)
+                    Idle(due);
+                else if (clock::now() < m_outputsFreeAt[m_nextOutput])
+                    Idle(std::min(due, m_outputsFreeAt[m_nextOutput]));
+                else if (effect)
+                    DrawEffect();
+                else if (clock::now() < m_nextFade)
+                    Idle(std::min(due, m_nextFade));
+                else
+                    DrawFade();
+                continue;
+            }
+            m_lastByte = clock::now();
+            if (m_hunting && static_cast<DataType>(x) != DataType::Framed)
+                continue;
+            switch (static_cast<DataType>(x)) {
+                case DataType::Power: ReadPower();
+                    break;
+                case DataType::Data: ReadData();
+                    break;
+                case DataType::Ping: ReadPing();
+                    break;
+                case DataType::Spans: ReadSpans();
+                    break;
+                case DataType::Compressed: ReadCompressed();
+                    break;
+                case DataType::Credits: ReadCredits();
+                    break;
+                case DataType::Effect: ReadEffect();
+                    break;
+                case DataType::Interpolate: ReadInterpolate();
+                    break;
+                case DataType::Timed: ReadTimed();
+                    break;
+                case DataType::Framed: ReadFramed();
+                    break;
+            }
+            m_cpuSeconds = threadCpuSeconds();
+        }
+    }
+    catch (const EmulatorStopped&) { }
+    m_cpuSeconds = threadCpuSeconds();
+}
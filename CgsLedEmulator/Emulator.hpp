@@ -0,0 +1,199 @@
+#pragma once
+
+#include "blend.hpp"
+#include "effects.hpp"
+#include "protocol.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct EmulatorConfig {
+    // leds per strip, the strips are driven in parallel like the pio state machines on the pico
+    std::vector<size_t> strips { 177, 82, 30 };
+    // usb full speed cdc realistically does about 1MB/s
+    double bytesPerSecond = 1000000.0;
+    // added on top of the bandwidth delay before a byte reaches the firmware
+    std::chrono::microseconds latency { 0 };
+    // ws2812 bit time * 24, plus the latch after the last led
+    std::chrono::nanoseconds ledTime { 30000 };
+    std::chrono::microseconds latchTime { 300 };
+    // same receive queue as the pico, also decides the credits handed out
+    size_t rxQueueSize = 4096;
+    // loses every nth byte like a uart overrun would, 0 never does
+    uint64_t dropEvery = 0;
+};
+
+struct EmulatorStats {
+    uint64_t bytes;
+    uint64_t frames;
+    // in between frames the interpolation put out
+    uint64_t fades;
+    uint64_t pings;
+    uint64_t powerChanges;
+    // bytes thrown away by dropEvery, and framed messages that were reported back as rejected or missing
+    uint64_t dropped;
+    uint64_t rejected;
+    // timed frames that were already due when they came in, and ones due too far ahead to hold
+    uint64_t late;
+    uint64_t early;
+    // time the firmware loop spent on the cpu, not counting waiting for the link or the strips
+    double cpuSeconds;
+};
+
+// speaks the same serial protocol as CgsLedPiPico/main.cpp on the master side of a pty,
+// the host opens Port() like it would open the real board
+class Emulator {
+public:
+    explicit Emulator(const EmulatorConfig& config);
+    ~Emulator();
+
+    Emulator(const Emulator&) = delete;
+    Emulator& operator=(const Emulator&) = delete;
+
+    // --strips 177,82,30 --bandwidth <bytes/s, 0 for unlimited> --latency <us> --led-time <ns> --rx-queue <bytes>
+    // --drop-every <bytes>,
+    // false if name isn't one of those or value doesn't parse
+    static bool ParseOption(EmulatorConfig& config, std::string_view name, std::string_view value);
+
+    const std::string& Port() const { return m_port; }
+
+    // runs the firmware loop until Stop()
+    void Run();
+    void Stop() { m_stopping = true; }
+
+    EmulatorStats GetStats() const;
+    // the grb bytes currently on the strips
+    std::vector<uint8_t> Snapshot() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Packet {
+        clock::time_point at;
+        size_t end;
+    };
+
+    // pulls whatever the host wrote into the receive queue and releases the bytes that made it over the link
+    void Poll();
+    // sleeps until the next packet arrives, the host writes something or until, at most a few ms so Stop() is noticed
+    void Idle(clock::time_point until);
+    bool TryRead(uint8_t& x);
+    uint8_t ReadNext();
+    // false if it isn't all there by deadline, whatever did come is used up anyway
+    bool ReadLink(uint8_t* current, size_t remaining, clock::time_point deadline);
+    void ReadInto(uint8_t* current, size_t remaining);
+    // what the decoding in protocol.hpp reads from, the same as the pico's
+    struct Source {
+        Emulator& emulator;
+        uint8_t next() { return emulator.ReadNext(); }
+        void into(uint8_t* current, size_t remaining) { emulator.ReadInto(current, remaining); }
+    };
+    void Write(uint8_t x);
+    // the pong with the clock and whatever late or early frames haven't been reported yet
+    void WritePong();
+    // the pico's microsecond timer, from when the emulator started
+    uint32_t DeviceTime() const;
+
+    void WaitForOutput();
+    void ShowAll();
+    void Show(const uint8_t* frame);
+    // a whole new frame from the host is in m_data
+    void ShowReceived();
+    // the earliest held frame, waiting for an output like any other
+    void ShowHeld();
+    void SetPower(uint8_t value);
+
+    void ReadPower();
+    void ReadData();
+    void ReadSpans();
+    void ReadCompressed();
+    void ReadCredits();
+    void ReadEffect();
+    void DrawEffect();
+    void ReadInterpolate();
+    void ReadTimed();
+    void DrawFade();
+    void ReadPing();
+    void ReportDropped(uint8_t count);
+    void ReadFramed();
+
+    EmulatorConfig m_config;
+    size_t m_totalDataCount;
+    size_t m_longestStrip;
+    uint8_t m_frameCredits;
+
+    int m_master = -1;
+    // kept open so the pty doesn't hang up whenever the host closes it
+    int m_slave = -1;
+    std::string m_port;
+    std::atomic<bool> m_stopping = false;
+
+    // everything below rxReady has arrived, rxReady to rxTail is still on the link
+    std::vector<uint8_t> m_rxQueue;
+    size_t m_rxHead = 0;
+    size_t m_rxReady = 0;
+    size_t m_rxTail = 0;
+    std::deque<Packet> m_packets;
+    clock::time_point m_linkFree;
+
+    // framed messages are checked in here first and the handlers read from it instead of the queue
+    std::vector<uint8_t> m_frame;
+    const uint8_t* m_frameCursor = nullptr;
+    const uint8_t* m_frameEnd = nullptr;
+    protocol::Sequence m_sequence;
+    bool m_hunting = false;
+    clock::time_point m_lastByte;
+    uint64_t m_dropCounter = 0;
+
+    // what the pico's usb core decodes into, frames get read into it while the strips are still busy
+    std::vector<uint8_t> m_data;
+    std::array<uint8_t, 256 * 3> m_palette {};
+    clock::time_point m_stripsBusyUntil;
+    // when each of the usb core's outputs gets handed back, they're used round robin
+    std::array<clock::time_point, 2> m_outputsFreeAt {};
+    size_t m_nextOutput = 0;
+    bool m_powered = false;
+    effects::Params m_effect;
+    clock::time_point m_effectStart;
+    // fades from whatever's showing to every new frame like the pico does, see main.cpp there
+    blend::Params m_interpolation;
+    std::vector<uint8_t> m_fadeFrom;
+    std::vector<uint8_t> m_faded;
+    bool m_fading = false;
+    clock::time_point m_fadeStart;
+    clock::time_point m_nextFade;
+    clock::time_point m_lastReceived;
+    std::chrono::microseconds m_frameInterval { 1000000 / 60 };
+    // timed frames held until they're due, earliest first. the pico holds them in the outputs that aren't going out
+    struct Held {
+        clock::time_point due;
+        std::vector<uint8_t> frame;
+    };
+    std::deque<Held> m_held;
+    bool m_timed = false;
+    uint32_t m_dueUs = 0;
+    clock::time_point m_epoch;
+    uint64_t m_reportedLate = 0;
+    uint64_t m_reportedEarly = 0;
+    // copy of m_data taken whenever a frame is handed to the strips so Snapshot() doesn't race the firmware loop
+    mutable std::mutex m_shownMutex;
+    std::vector<uint8_t> m_shown;
+
+    std::atomic<uint64_t> m_bytes = 0;
+    std::atomic<uint64_t> m_frames = 0;
+    std::atomic<uint64_t> m_fades = 0;
+    std::atomic<uint64_t> m_pings = 0;
+    std::atomic<uint64_t> m_powerChanges = 0;
+    std::atomic<uint64_t> m_dropped = 0;
+    std::atomic<uint64_t> m_rejected = 0;
+    std::atomic<uint64_t> m_late = 0;
+    std::atomic<uint64_t> m_early = 0;
+    std::atomic<double> m_cpuSeconds = 0.0;
+};
@@ -0,0 +1,115 @@
+#include "ColorPacker.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// ns per led for turning openrgb's colors into strip bytes, the way DeviceUpdateLEDs used to do it in doubles
+// against ColorPacker's lut (gamma on) and every vector path (gamma off) this cpu runs. fails if a vector path ever
+// gives different bytes than the doubles did
+
+namespace reference {
+    // the old DeviceUpdateLEDs, always grb
+    void pack(const RGBColor* colors, size_t count, char* out, unsigned int brightness) {
+        for (size_t i = 0; i < count; i++) {
+            *out++ = static_cast<char>(((colors[i] >> 8) & 0xff) * brightness / 100.0);
+            *out++ = static_cast<char>((colors[i] & 0xff) * brightness / 100.0);
+            *out++ = static_cast<char>(((colors[i] >> 16) & 0xff) * brightness / 100.0);
+        }
+    }
+}
+
+// every brightness, with lengths that leave every possible tail for the scalar path, then every order
+static size_t check(ColorPacker& packer, const std::vector<RGBColor>& colors) {
+    size_t wrong = 0;
+    std::vector<char> expected(colors.size() * 3);
+    std::vector<char> actual(colors.size() * 3);
+    const ColorOrder grb = ColorPacker::ParseOrder("GRB");
+    for (unsigned int brightness = 0; brightness <= 100; brightness++) {
+        packer.SetBrightness(brightness, false);
+        for (size_t count = 0; count < 40; count++) {
+            reference::pack(colors.data(), count, expected.data(), brightness);
+            packer.Pack(colors.data(), count, actual.data(), grb);
+            wrong += memcmp(expected.data(), actual.data(), count * 3) != 0;
+        }
+        reference::pack(colors.data(), colors.size(), expected.data(), brightness);
+        packer.Pack(colors.data(), colors.size(), actual.data(), grb);
+        wrong += memcmp(expected.data(), actual.data(), actual.size()) != 0;
+    }
+    // the other orders just move the same bytes around
+    for (const char* name : { "RGB", "RBG", "GBR", "BRG", "BGR" }) {
+        const ColorOrder order = ColorPacker::ParseOrder(name);
+        packer.SetBrightness(37, false);
+        packer.Pack(colors.data(), colors.size(), actual.data(), order);
+        reference::pack(colors.data(), colors.size(), expected.data(), 37);
+        for (size_t i = 0; i < colors.size(); i++) {
+            // reference is g, r, b
+            const char channels[3] = { expected[i * 3 + 1], expected[i * 3], expected[i * 3 + 2] };
+            for (size_t j = 0; j < 3; j++)
+                wrong += actual[i * 3 + j] != channels[order[j]];
+        }
+    }
+    return wrong;
+}
+
+int main(int argc, char** argv) {
+    // leds packed per size and path, about what a few seconds of a big setup at 60 fps is
+    const size_t work = argc > 1 ? strtoul(argv[1], nullptr, 10) : 30000000;
+    if (work == 0) {
+        fprintf(stderr, "usage: %s [leds per size]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<RGBColor> colors(30000);
+    uint32_t seed = 1;
+    for (auto& color : colors) {
+        seed = seed * 1664525u + 1013904223u;
+        color = seed >> 8;
+    }
+
+    std::vector<ColorPacker::Vector> vectors;
+    for (auto vector : { ColorPacker::Vector::Sse2, ColorPacker::Vector::Avx2 }) {
+        if (vector <= ColorPacker::BestVector())
+            vectors.push_back(vector);
+        else
+            printf("no %s on this cpu or in this build\n", ColorPacker::VectorName(vector));
+    }
+
+    size_t wrong = 0;
+    ColorPacker packer;
+    std::vector<char> actual(colors.size() * 3);
+    const ColorOrder grb = ColorPacker::ParseOrder("GRB");
+    for (auto vector : vectors) {
+        packer.SetVector(vector);
+        wrong += check(packer, colors);
+    }
+    printf("%zu packs different from the doubles\n", wrong);
+
+    size_t checksum = 0;
+    printf("%-8s %10s %10s %10s\n", "ns/led", "300", "3000", "30000");
+    // doubles, the lut and then every vector path
+    for (size_t path = 0; path < 2 + vectors.size(); path++) {
+        printf("%-8s", path == 0 ? "doubles" : path == 1 ? "lut" : ColorPacker::VectorName(vectors[path - 2]));
+        packer.SetBrightness(80, path == 1);
+        if (path >= 2)
+            packer.SetVector(vectors[path - 2]);
+        for (size_t count : { 300, 3000, 30000 }) {
+            const size_t rounds = std::max<size_t>(work / count, 1);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t round = 0; round < rounds; round++) {
+                if (path == 0)
+                    reference::pack(colors.data(), count, actual.data(), 80);
+                else
+                    packer.Pack(colors.data(), count, actual.data(), grb);
+                checksum += static_cast<uint8_t>(actual[round % (count * 3)]);
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            printf(" %10.2f", ns / (rounds * count));
+        }
+        printf("\n");
+    }
+    // keeps the packs from being optimized out
+    return wrong > 0 || checksum == SIZE_MAX ? 1 : 0;
+}
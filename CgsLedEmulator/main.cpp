@@ -0,0 +1,73 @@
+#include "Emulator.hpp"
+#include <csignal>
+#include <cstdio>
+#include <exception>
+#include <string_view>
+#include <unistd.h>
+
+static Emulator* s_emulator = nullptr;
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [--strips 177,82,30] [--bandwidth 1000000] [--latency 0] [--led-time 30000] [--rx-queue 4096]\n"
+        "       [--drop-every 0] [--link <path>]\n"
+        "opens a pty that behaves like the pico, point the plugin's port setting at the printed path or --link\n",
+        name);
+}
+
+int main(int argc, char** argv) {
+    EmulatorConfig config;
+    const char* link = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view name = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++i];
+        if (name == "--link") {
+            link = value.data();
+            continue;
+        }
+        if (!Emulator::ParseOption(config, name, value)) {
+            fprintf(stderr, "bad option %s %s\n", name.data(), value.data());
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    try {
+        Emulator emulator(config);
+        if (link) {
+            unlink(link);
+            if (symlink(emulator.Port().c_str(), link) != 0) {
+                perror("symlink");
+                return 1;
+            }
+        }
+        printf("%s\n", emulator.Port().c_str());
+        fflush(stdout);
+
+        s_emulator = &emulator;
+        std::signal(SIGINT, [](int) { s_emulator->Stop(); });
+        std::signal(SIGTERM, [](int) { s_emulator->Stop(); });
+        emulator.Run();
+        s_emulator = nullptr;
+
+        if (link)
+            unlink(link);
+        EmulatorStats stats = emulator.GetStats();
+        printf("bytes=%llu frames=%llu fades=%llu pings=%llu power=%llu dropped=%llu rejected=%llu late=%llu early=%llu "
+            "cpu=%.3fs\n",
+            static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.frames),
+            static_cast<unsigned long long>(stats.fades), static_cast<unsigned long long>(stats.pings),
+            static_cast<unsigned long long>(stats.powerChanges), static_cast<unsigned long long>(stats.dropped),
+            static_cast<unsigned long long>(stats.rejected), static_cast<unsigned long long>(stats.late),
+            static_cast<unsigned long long>(stats.early), stats.cpuSeconds);
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
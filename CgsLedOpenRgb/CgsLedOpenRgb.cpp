@@ -1,7 +1,7 @@
 #include "CgsLedOpenRgb.hpp"
 #include "CgsLedRgbController.hpp"
 #include "SettingsManager.h"
-#include <QHBoxLayout>
+#include "TelemetryWidget.hpp"
 #include <nlohmann/json.hpp>
 
 ResourceManagerInterface* CgsLedOpenRgb::s_res = nullptr;
@@ -37,6 +37,27 @@ void CgsLedOpenRgb::Load(ResourceManagerInterface* res) {
         settings["baud"] = 12000000;
     if (!settings.contains("brightness"))
         settings["brightness"] = 40u;
+    if (!settings.contains("compress"))
+        settings["compress"] = true;
+    if (!settings.contains("indexed"))
+        settings["indexed"] = false;
+    if (!settings.contains("gamma"))
+        settings["gamma"] = false;
+    if (!settings.contains("fps"))
+        settings["fps"] = 60u;
+    if (!settings.contains("interpolate"))
+        settings["interpolate"] = "off";
+    if (!settings.contains("interpolate_rate"))
+        settings["interpolate_rate"] = 0u;
+    if (!settings.contains("delay_ms"))
+        settings["delay_ms"] = 0u;
+    if (!settings.contains("zones")) {
+        settings["zones"] = json::array({
+            { { "name", "Window" }, { "leds", 177u }, { "order", "GRB" } },
+            { { "name", "Door" }, { "leds", 82u }, { "order", "GRB" } },
+            { { "name", "Monitor" }, { "leds", 30u }, { "order", "GRB" } }
+        });
+    }
     res->GetSettingsManager()->SetSettings("CgsLed", settings);
 
     res->RegisterDetectionEndCallback(&DetectDevices, nullptr);
@@ -44,13 +65,7 @@ void CgsLedOpenRgb::Load(ResourceManagerInterface* res) {
 }
 
 QWidget* CgsLedOpenRgb::GetWidget() {
-    QWidget* widget =  new QWidget(nullptr);
-    QHBoxLayout* layout = new QHBoxLayout();
-
-    widget->setLayout(layout);
-    layout->addWidget(new QLabel("Allo, allo?"));
-
-    return widget;
+    return new TelemetryWidget(nullptr);
 }
 
 QMenu* CgsLedOpenRgb::GetTrayMenu() {
@@ -71,11 +86,29 @@ void CgsLedOpenRgb::DetectDevices(void*) {
     if (!std::any_of(ports.begin(), ports.end(), [&](std::string x) { return x == settings["port"].get<std::string>(); }))
         return;
 
-    auto* controller = new CgsLedRgbController(
-        settings["port"].get<std::string>().c_str(),
-        settings["baud"].get<int>(),
-        settings.contains("brightness") ? settings["brightness"].get<unsigned int>() : 40u
-    );
+    CgsLedConfig config;
+    config.port = settings["port"].get<std::string>();
+    config.baud = settings["baud"].get<int>();
+    config.brightness = settings.contains("brightness") ? settings["brightness"].get<unsigned int>() : 40u;
+    config.compress = settings.contains("compress") ? settings["compress"].get<bool>() : true;
+    config.indexed = settings.contains("indexed") ? settings["indexed"].get<bool>() : false;
+    config.gamma = settings.contains("gamma") ? settings["gamma"].get<bool>() : false;
+    config.fps = settings.contains("fps") ? settings["fps"].get<unsigned int>() : 60u;
+    std::string interpolate = settings.contains("interpolate") ? settings["interpolate"].get<std::string>() : "off";
+    config.interpolate = interpolate == "linear" ? 1 : interpolate == "eased" ? 2 : 0;
+    config.interpolateRate = settings.contains("interpolate_rate") ? settings["interpolate_rate"].get<unsigned int>() : 0u;
+    config.delayMs = settings.contains("delay_ms") ? settings["delay_ms"].get<unsigned int>() : 0u;
+    if (settings.contains("zones")) {
+        for (const auto& zone : settings["zones"]) {
+            config.zones.push_back({
+                zone.contains("name") ? zone["name"].get<std::string>() : "Zone",
+                zone.contains("leds") ? zone["leds"].get<unsigned int>() : 0u,
+                ColorPacker::ParseOrder(zone.contains("order") ? zone["order"].get<std::string>() : "GRB")
+            });
+        }
+    }
+
+    auto* controller = new CgsLedRgbController(config);
 
     CgsLedOpenRgb::s_res->RegisterRGBController(controller);
 }
@@ -68,11 +68,22 @@ DEFINES +=
 #-----------------------------------------------------------------------------------------------#
 HEADERS +=                                                                                      \
     CgsLedOpenRgb.hpp                                                                       \
-    CgsLedRgbController.hpp
+    CgsLedRgbController.hpp \
+    ColorPacker.hpp \
+    Compressor.hpp \
+    LatencyHistogram.hpp \
+    TelemetryWidget.hpp
 
 SOURCES +=                                                                                      \
     CgsLedOpenRgb.cpp                                                                     \
     CgsLedRgbController.cpp \
+    ColorPacker.cpp \
+    Compressor.cpp \
+    TelemetryWidget.cpp \
+
+# the framing crc is shared with the pico firmware
+INCLUDEPATH +=                                                                                  \
+    ../CgsLedPiPico                                                                             \
 
 RESOURCES +=                                                                                    \
     resources.qrc
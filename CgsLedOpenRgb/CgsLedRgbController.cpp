@@ -1,15 +1,47 @@
 #include "CgsLedRgbController.hpp"
+#include "crc.hpp"
 
-CgsLedRgbController::CgsLedRgbController(const char* port, int baud, unsigned int brightness) {
-    m_serial = new serial_port(port, baud);
+std::mutex CgsLedRgbController::s_instancesMutex;
+std::vector<CgsLedRgbController*> CgsLedRgbController::s_instances;
+
+// marker, u16 length and sequence in front of the type of a framed message, its crc or the ping of an unframed one after
+constexpr size_t framePrefix = 4;
+constexpr size_t frameSuffix = 2;
+// a message whose marker got mangled never gets a pong or an error back
+constexpr auto pongTimeout = std::chrono::seconds(1);
+// openrgb's serial_port never blocks on a read, so waiting for replies means looking again this often
+constexpr auto replyPoll = std::chrono::milliseconds(1);
+// the type and due time in front of a timed frame
+constexpr size_t timedPrefix = 5;
+// the quickest round trip in every window of this sets the clock offset, crystals drift a few ms a minute.
+// with a delay there's a bare ping a few times a window so there's always a quick one
+constexpr auto clockWindow = std::chrono::seconds(2);
+constexpr auto clockPing = std::chrono::milliseconds(500);
+
+static int64_t microseconds(std::chrono::steady_clock::time_point at) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(at.time_since_epoch()).count();
+}
+
+CgsLedRgbController::CgsLedRgbController(const CgsLedConfig& config) : m_config(config) {
+    m_serial = new serial_port(m_config.port.c_str(), m_config.baud);
     m_serial->serial_set_dtr(true);
 
-    m_buffer = new char[1024];
-    memset(m_buffer, 0, 1024);
+    size_t ledCount = 0;
+    for (const auto& zone : m_config.zones)
+        ledCount += zone.leds;
+    // the type and a u16 header plus the frame is more than any encoding can take
+    size_t frameSize = ledCount * 3;
+    size_t messageSize = framePrefix + timedPrefix + 3 + frameSize + frameSuffix;
+    m_pending.resize(frameSize);
+    m_frame.resize(frameSize);
+    m_sent.resize(frameSize);
+    m_buffer.resize(messageSize);
+    m_scratch.resize(messageSize);
+    m_compressor.Reserve(ledCount);
 
     name = "CG's LED";
     type = DEVICE_TYPE_LEDSTRIP;
-    location = port;
+    location = m_config.port;
 
     mode off;
     off.name = "Off";
@@ -24,7 +56,7 @@ CgsLedRgbController::CgsLedRgbController(const char* port, int baud, unsigned in
     direct.flags = MODE_FLAG_HAS_PER_LED_COLOR | MODE_FLAG_HAS_BRIGHTNESS;
     direct.brightness_min = 0;
     direct.brightness_max = 100;
-    direct.brightness = brightness;
+    direct.brightness = m_config.brightness;
     direct.color_mode = MODE_COLORS_PER_LED;
     this->modes.push_back(direct);
 
@@ -36,58 +68,46 @@ CgsLedRgbController::CgsLedRgbController(const char* port, int baud, unsigned in
     this->modes.push_back(freddy);
 
     SetupZones();
+
+    m_writer = std::thread(&CgsLedRgbController::WriterThread, this);
+
+    std::lock_guard lock(s_instancesMutex);
+    s_instances.push_back(this);
 }
 
 CgsLedRgbController::~CgsLedRgbController() {
+    {
+        std::lock_guard lock(s_instancesMutex);
+        s_instances.erase(std::remove(s_instances.begin(), s_instances.end(), this), s_instances.end());
+    }
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_writer.join();
+
     m_serial->serial_close();
     delete m_serial;
-    delete[] m_buffer;
 }
 
 void CgsLedRgbController::SetupZones() {
-    zone windowZone;
-    windowZone.name = "Window";
-    windowZone.type = ZONE_TYPE_LINEAR;
-    windowZone.leds_count = 177;
-    windowZone.leds_min = windowZone.leds_count;
-    windowZone.leds_max = windowZone.leds_count;
-    windowZone.matrix_map = NULL;
-    this->zones.push_back(windowZone);
-    for (size_t i = 0; i < windowZone.leds_count; i++) {
-        led x;
-        x.name = "Window LED ";
-        x.name.append(std::to_string(i));
-        this->leds.push_back(x);
-    }
-
-    zone doorZone;
-    doorZone.name = "Door";
-    doorZone.type = ZONE_TYPE_LINEAR;
-    doorZone.leds_count = 82;
-    doorZone.leds_min = doorZone.leds_count;
-    doorZone.leds_max = doorZone.leds_count;
-    doorZone.matrix_map = NULL;
-    this->zones.push_back(doorZone);
-    for (size_t i = 0; i < doorZone.leds_count; i++) {
-        led x;
-        x.name = "Door LED ";
-        x.name.append(std::to_string(i));
-        this->leds.push_back(x);
-    }
-
-    zone monitorZone;
-    monitorZone.name = "Monitor";
-    monitorZone.type = ZONE_TYPE_LINEAR;
-    monitorZone.leds_count = 30;
-    monitorZone.leds_min = monitorZone.leds_count;
-    monitorZone.leds_max = monitorZone.leds_count;
-    monitorZone.matrix_map = NULL;
-    this->zones.push_back(monitorZone);
-    for (size_t i = 0; i < doorZone.leds_count; i++) {
-        led x;
-        x.name = "Monitor LED ";
-        x.name.append(std::to_string(i));
-        this->leds.push_back(x);
+    for (const auto& config : m_config.zones) {
+        zone z;
+        z.name = config.name;
+        z.type = ZONE_TYPE_LINEAR;
+        z.leds_count = config.leds;
+        z.leds_min = z.leds_count;
+        z.leds_max = z.leds_count;
+        z.matrix_map = NULL;
+        this->zones.push_back(z);
+        for (size_t i = 0; i < z.leds_count; i++) {
+            led x;
+            x.name = config.name + " LED ";
+            x.name.append(std::to_string(i));
+            this->leds.push_back(x);
+        }
     }
 
     SetupColors();
@@ -99,25 +119,21 @@ void CgsLedRgbController::DeviceUpdateLEDs() {
     if (this->active_mode != 1)
         return;
 
-    size_t off = 0;
-    m_buffer[off++] = static_cast<char>(DataType::Data);
-    for (size_t i = 0; i < this->colors.size(); i++) {
-        m_buffer[off++] = static_cast<char>(RGBGetGValue(this->colors[i]) * this->modes[1].brightness / 100.0);
-        m_buffer[off++] = static_cast<char>(RGBGetRValue(this->colors[i]) * this->modes[1].brightness / 100.0);
-        m_buffer[off++] = static_cast<char>(RGBGetBValue(this->colors[i]) * this->modes[1].brightness / 100.0);
+    std::lock_guard lock(m_mutex);
+    m_packer.SetBrightness(this->modes[1].brightness, m_config.gamma);
+    size_t start = 0;
+    for (const auto& zone : m_config.zones) {
+        m_packer.Pack(this->colors.data() + start, zone.leds, m_pending.data() + start * 3, zone.order);
+        start += zone.leds;
     }
-    m_buffer[off++] = static_cast<char>(DataType::Ping);
-
-    // wait for the result of the last ping
-    while (!m_canContinue) {
-        char x;
-        int read = m_serial->serial_read(&x, 1);
-        if (read > 0 && x == 0)
-            m_canContinue = true;
-    }
-    m_canContinue = false;
+    m_pendingSize = start * 3;
+    m_pendingAt = std::chrono::steady_clock::now();
 
-    m_serial->serial_write(m_buffer, static_cast<int>(off));
+    m_requestedFrames++;
+    if (m_framePending)
+        m_coalescedFrames++;
+    m_framePending = true;
+    m_wake.notify_one();
 }
 
 void CgsLedRgbController::UpdateZoneLEDs(int) { this->DeviceUpdateLEDs(); }
@@ -125,17 +141,413 @@ void CgsLedRgbController::UpdateZoneLEDs(int) { this->DeviceUpdateLEDs(); }
 void CgsLedRgbController::UpdateSingleLED(int) { this->DeviceUpdateLEDs(); }
 
 void CgsLedRgbController::DeviceUpdateMode() {
-    while (!m_canContinue) {
-        char x;
-        int read = m_serial->serial_read(&x, 1);
-        if (read > 0 && x == 0)
-            m_canContinue = true;
+    std::lock_guard lock(m_mutex);
+    m_pendingMode = this->active_mode;
+    m_modePending = true;
+    // a frame published before switching away from direct must not light the strips back up
+    if (m_pendingMode != 1 && m_framePending) {
+        m_framePending = false;
+        m_coalescedFrames++;
     }
-    m_canContinue = false;
+    m_wake.notify_one();
+}
+
+static void writeU16(char* buffer, size_t& off, size_t value) {
+    buffer[off++] = static_cast<char>(value & 0xff);
+    buffer[off++] = static_cast<char>((value >> 8) & 0xff);
+}
+
+size_t CgsLedRgbController::EncodeSpans(size_t size) {
+    // offsets are u16 so longer layouts always go raw or compressed
+    if (m_sentSize != size || m_sentIndexed || size / 3 > 0xffff)
+        return 0;
 
-    char data[3] {
-        static_cast<char>(DataType::Power), static_cast<char>(this->active_mode),
-        static_cast<char>(DataType::Ping)
+    // merging two spans is cheaper than a new span header when they're at most this many leds apart
+    constexpr size_t spanHeaderSize = 4;
+    constexpr size_t maxGap = spanHeaderSize / 3;
+
+    const size_t ledCount = size / 3;
+    const size_t rawSize = 1 + size;
+    char* out = m_buffer.data() + framePrefix;
+
+    size_t off = 3;
+    size_t spanCount = 0;
+    size_t i = 0;
+    while (i < ledCount) {
+        if (memcmp(&m_frame[i * 3], &m_sent[i * 3], 3) == 0) {
+            i++;
+            continue;
+        }
+
+        size_t start = i;
+        size_t end = i + 1;
+        for (size_t j = end; j < ledCount && j - end <= maxGap; j++) {
+            if (memcmp(&m_frame[j * 3], &m_sent[j * 3], 3) != 0)
+                end = j + 1;
+        }
+
+        size_t length = end - start;
+        if (off + spanHeaderSize + length * 3 >= rawSize)
+            return 0;
+        writeU16(out, off, start);
+        writeU16(out, off, length);
+        memcpy(&out[off], &m_frame[start * 3], length * 3);
+        off += length * 3;
+        spanCount++;
+        i = end;
+    }
+
+    size_t header = 0;
+    out[header++] = static_cast<char>(DataType::Spans);
+    writeU16(out, header, spanCount);
+    return off;
+}
+
+size_t CgsLedRgbController::EncodeCompressed(size_t size) {
+    char* out = m_scratch.data() + framePrefix;
+    size_t off = m_compressor.Encode(m_frame.data(), size, &out[1]);
+    if (off == 0)
+        return 0;
+    out[0] = static_cast<char>(DataType::Compressed);
+    return 1 + off;
+}
+
+size_t CgsLedRgbController::EncodeIndexed(size_t size) {
+    char* out = m_scratch.data() + framePrefix;
+    size_t off = m_compressor.EncodeIndexed(m_frame.data(), size, &out[1]);
+    if (off == 0)
+        return 0;
+    out[0] = static_cast<char>(DataType::Indexed);
+    return 1 + off;
+}
+
+CgsLedStats CgsLedRgbController::GetStats() const {
+    double frameTime = m_frameTime;
+    return {
+        m_requestedFrames,
+        m_sentFrames,
+        m_coalescedFrames,
+        m_errors,
+        m_lost,
+        frameTime > 0.0 ? 1.0 / frameTime : 0.0,
+        m_sentBytes,
+        m_blockedSeconds,
+        m_credits,
+        m_latency.Snapshot(),
+        m_late,
+        m_early,
+        m_clockKnown,
+        static_cast<int32_t>(m_clockOffset.load()),
+        m_clockErrorUs
     };
-    m_serial->serial_write(data, 3);
+}
+
+static size_t replyPayloadSize(ReplyType type) {
+    switch (type) {
+        case ReplyType::Credits: return 1;
+        case ReplyType::Errors: return 1;
+        case ReplyType::Clock: return 5;
+        case ReplyType::Timing: return 2;
+        case ReplyType::Lost: return 1;
+        default: return 0;
+    }
+}
+
+int CgsLedRgbController::ReadReplies() {
+    char buffer[64];
+    int read = m_serial->serial_read(buffer, sizeof(buffer));
+    for (int i = 0; i < read; i++)
+        HandleReply(static_cast<uint8_t>(buffer[i]));
+
+    auto now = std::chrono::steady_clock::now();
+    while (!m_inFlight.empty() && now - m_inFlight.front().first > pongTimeout) {
+        m_inFlight.pop_front();
+        m_errors++;
+        m_resend = true;
+    }
+    return read;
+}
+
+bool CgsLedRgbController::WaitForReplies() {
+    if (ReadReplies() > 0)
+        return !m_stopping;
+    std::unique_lock lock(m_mutex);
+    m_wake.wait_for(lock, replyPoll, [this] { return m_stopping.load(); });
+    return !m_stopping;
+}
+
+void CgsLedRgbController::HandleReply(uint8_t x) {
+    // payload bytes always have the high bit set so they can never be mistaken for a pong
+    if (x & 0x80) {
+        size_t size = replyPayloadSize(m_replyType);
+        if (m_replySize >= size)
+            return;
+        m_replyPayload[m_replySize++] = x & 0x7f;
+        if (m_replySize < size)
+            return;
+        switch (m_replyType) {
+            case ReplyType::Credits: m_credits = std::max<size_t>(m_replyPayload[0], 1);
+                m_framed = true;
+                break;
+            case ReplyType::Errors:
+                // those messages aren't in flight anymore, and whatever they carried never made it to the strips
+                for (size_t i = 0; i < m_replyPayload[0] && !m_inFlight.empty(); i++)
+                    m_inFlight.pop_front();
+                m_errors += m_replyPayload[0];
+                m_resend = true;
+                break;
+            case ReplyType::Clock: {
+                uint32_t device = 0;
+                for (size_t i = 0; i < 5; i++)
+                    device |= static_cast<uint32_t>(m_replyPayload[i]) << (i * 7);
+                m_pico = true;
+                AddClockSample(device);
+                break;
+            }
+            case ReplyType::Timing:
+                m_late += m_replyPayload[0];
+                m_early += m_replyPayload[1];
+                break;
+            // a raw message that lost bytes swallows whatever comes after it, the next frame has to be whole again
+            case ReplyType::Lost:
+                m_lost += m_replyPayload[0];
+                m_resend = true;
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+
+    m_replyType = static_cast<ReplyType>(x);
+    m_replySize = 0;
+    if (m_replyType == ReplyType::Ready) {
+        m_deviceReset = true;
+        m_resend = true;
+        return;
+    }
+    if (m_replyType != ReplyType::Pong || m_inFlight.empty())
+        return;
+
+    // pongs come back in order, and a message can't have started going out before the previous one was done
+    auto now = std::chrono::steady_clock::now();
+    auto [sent, frame] = m_inFlight.front();
+    m_inFlight.pop_front();
+    m_latency.Add(std::chrono::duration<double>(now - sent).count());
+    m_pongSent = sent;
+    m_pongReceived = now;
+    double seconds = std::chrono::duration<double>(now - std::max(sent, m_lastPong)).count();
+    m_lastPong = now;
+    if (!frame)
+        return;
+    double frameTime = m_frameTime;
+    m_frameTime = frameTime > 0.0 ? frameTime * 0.9 + seconds * 0.1 : seconds;
+}
+
+void CgsLedRgbController::AddClockSample(uint32_t device) {
+    // the device read its clock somewhere in between, the middle is the best guess there is
+    const auto roundTrip = m_pongReceived - m_pongSent;
+    const uint32_t offset = device - static_cast<uint32_t>(microseconds(m_pongSent + roundTrip / 2));
+    if (roundTrip < m_bestRoundTrip) {
+        m_bestRoundTrip = roundTrip;
+        m_bestOffset = offset;
+    }
+    if (m_clockKnown && m_pongReceived - m_clockWindowStart < clockWindow)
+        return;
+    m_clockOffset = m_bestOffset;
+    m_clockErrorUs = std::chrono::duration_cast<std::chrono::microseconds>(m_bestRoundTrip).count() / 2;
+    m_clockKnown = true;
+    m_clockWindowStart = m_pongReceived;
+    m_bestRoundTrip = std::chrono::steady_clock::duration::max();
+}
+
+std::vector<std::pair<std::string, CgsLedStats>> CgsLedRgbController::GetAllStats() {
+    std::lock_guard lock(s_instancesMutex);
+    std::vector<std::pair<std::string, CgsLedStats>> res;
+    for (const auto* controller : s_instances)
+        res.emplace_back(controller->location, controller->GetStats());
+    return res;
+}
+
+bool CgsLedRgbController::Send(char* message, size_t size, bool frame) {
+    // a frame's length is a u16. past 21845 leds a raw frame doesn't fit in one, and splitting it would have the
+    // device show every piece on its own, so those go out unframed without a crc, like to a device without credits
+    if (!m_framed || size > 0xffff) {
+        message[size++] = static_cast<char>(DataType::Ping);
+        return Transmit(message, size, frame);
+    }
+
+    char* start = message - framePrefix;
+    size_t off = 0;
+    start[off++] = static_cast<char>(DataType::Framed);
+    writeU16(start, off, size);
+    start[off++] = static_cast<char>(m_sequence++);
+    off += size;
+    uint16_t check = crc::update(crc::init, reinterpret_cast<const uint8_t*>(start + 1), off - 1);
+    writeU16(start, off, check);
+    return Transmit(start, off, frame);
+}
+
+bool CgsLedRgbController::Transmit(const char* data, size_t size, bool frame) {
+    auto start = std::chrono::steady_clock::now();
+    while (m_inFlight.size() >= m_credits) {
+        if (!WaitForReplies())
+            return false;
+    }
+    m_serial->serial_write(const_cast<char*>(data), static_cast<int>(size));
+    auto now = std::chrono::steady_clock::now();
+    m_inFlight.emplace_back(now, frame);
+
+    m_blockedSeconds = m_blockedSeconds + std::chrono::duration<double>(now - start).count();
+    m_sentBytes += size;
+    if (frame)
+        m_sentFrames++;
+    ReadReplies();
+    return true;
+}
+
+void CgsLedRgbController::WriterThread() {
+    using clock = std::chrono::steady_clock;
+    const auto interval = m_config.fps > 0 ?
+        std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / m_config.fps)) :
+        clock::duration::zero();
+    auto nextFrame = clock::now();
+    auto nextSync = clock::now();
+
+    // devices that don't know about credits just pong and we stay at one message in flight
+    char query[2] { static_cast<char>(DataType::Credits), static_cast<char>(DataType::Ping) };
+    if (!Transmit(query, 2, false))
+        return;
+    while (!m_inFlight.empty()) {
+        if (!WaitForReplies())
+            return;
+    }
+
+    while (true) {
+        bool sendMode;
+        bool sendFrame;
+        bool resend;
+        bool sendSync;
+        int mode;
+        size_t size;
+        // only a device that sent its clock can hold timed frames
+        const bool timed = m_config.delayMs > 0 && m_framed && m_clockKnown;
+        {
+            // mode changes and recovering from errors go out right away, frames wait for their slot and get coalesced meanwhile
+            std::unique_lock lock(m_mutex);
+            while (!m_stopping && !m_modePending && !m_resend && !(m_framePending && clock::now() >= nextFrame) &&
+                !(timed && clock::now() >= nextSync)) {
+                auto deadline = clock::time_point::max();
+                if (m_framePending)
+                    deadline = nextFrame;
+                if (timed)
+                    deadline = std::min(deadline, nextSync);
+                // keep an eye on the pongs of messages still in flight while there's nothing to send
+                if (!m_inFlight.empty())
+                    deadline = std::min(deadline, clock::now() + replyPoll);
+                if (deadline == clock::time_point::max())
+                    m_wake.wait(lock);
+                else
+                    m_wake.wait_until(lock, deadline);
+                if (!m_inFlight.empty()) {
+                    lock.unlock();
+                    ReadReplies();
+                    lock.lock();
+                }
+            }
+            if (m_stopping)
+                return;
+            resend = m_resend;
+            m_resend = false;
+            sendMode = m_modePending || (m_deviceReset && m_sentMode >= 0);
+            m_deviceReset = false;
+            sendFrame = m_framePending && clock::now() >= nextFrame;
+            sendSync = timed && clock::now() >= nextSync;
+            mode = m_modePending ? m_pendingMode : m_sentMode;
+            size = m_pendingSize;
+            m_modePending = false;
+            if (sendFrame) {
+                m_framePending = false;
+                m_frameAt = m_pendingAt;
+                std::swap(m_frame, m_pending);
+            }
+        }
+
+        // a newer frame replaces whatever got lost anyway
+        if (resend && !sendFrame && mode == 1 && m_sentSize > 0) {
+            memcpy(m_frame.data(), m_sent.data(), m_sentSize);
+            size = m_sentSize;
+            m_frameAt = clock::now();
+            sendFrame = true;
+        }
+        if (resend)
+            m_sentSize = 0;
+
+        if (sendMode) {
+            // the device may have redrawn the strips on its own, next frame has to be sent whole
+            m_sentSize = 0;
+            char data[framePrefix + 2 + frameSuffix];
+            data[framePrefix] = static_cast<char>(DataType::Power);
+            data[framePrefix + 1] = static_cast<char>(mode);
+            m_sentMode = mode;
+            if (!Send(data + framePrefix, 2, false))
+                return;
+            // goes along with every mode so a device that reset picks it up again. without our gamma the colors
+            // are meant for a screen, those fade better as light
+            if (m_config.interpolate > 0) {
+                const unsigned int rate = std::min(m_config.interpolateRate, 0xffffu);
+                char interpolate[framePrefix + 4 + frameSuffix];
+                interpolate[framePrefix] = static_cast<char>(DataType::Interpolate);
+                interpolate[framePrefix + 1] = static_cast<char>(m_config.interpolate | (m_config.gamma ? 0 : 0x80));
+                interpolate[framePrefix + 2] = static_cast<char>(rate & 0xff);
+                interpolate[framePrefix + 3] = static_cast<char>(rate >> 8);
+                if (!Send(interpolate + framePrefix, 4, false))
+                    return;
+            }
+        }
+
+        if (sendSync) {
+            nextSync = clock::now() + clockPing;
+            char ping[framePrefix + 1 + frameSuffix];
+            ping[framePrefix] = static_cast<char>(DataType::Ping);
+            if (!Send(ping + framePrefix, 1, false))
+                return;
+        }
+
+        if (sendFrame) {
+            size_t off = EncodeSpans(size);
+            // both replace the whole frame and are only understood by one of the devices each
+            size_t whole = m_config.compress && m_pico ? EncodeCompressed(size) :
+                m_config.indexed ? EncodeIndexed(size) : 0;
+            if (whole != 0 && (off == 0 || whole < off)) {
+                std::swap(m_buffer, m_scratch);
+                off = whole;
+            }
+            char* message = m_buffer.data() + framePrefix;
+            if (off == 0) {
+                message[off++] = static_cast<char>(DataType::Data);
+                memcpy(&message[off], m_frame.data(), size);
+                off += size;
+            }
+            memcpy(m_sent.data(), m_frame.data(), size);
+            m_sentSize = size;
+            m_sentIndexed = static_cast<DataType>(message[0]) == DataType::Indexed;
+            if (timed && !m_sentIndexed) {
+                const int64_t dueUs = microseconds(m_frameAt) + static_cast<int64_t>(m_config.delayMs) * 1000;
+                const uint32_t due = static_cast<uint32_t>(dueUs) + m_clockOffset;
+                memmove(message + timedPrefix, message, off);
+                size_t header = 0;
+                message[header++] = static_cast<char>(DataType::Timed);
+                writeU16(message, header, due & 0xffff);
+                writeU16(message, header, due >> 16);
+                off += timedPrefix;
+            }
+
+            // keep the cadence, but don't try to catch up after idling or falling behind
+            auto now = clock::now();
+            nextFrame = nextFrame + interval < now ? now + interval : nextFrame + interval;
+            if (!Send(message, off, true))
+                return;
+        }
+    }
 }
@@ -1,18 +1,117 @@
 #pragma once
 
+#include "ColorPacker.hpp"
+#include "Compressor.hpp"
+#include "LatencyHistogram.hpp"
 #include "RGBController.h"
 #include "serial_port.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
-enum class DataType : char {
+enum class DataType : uint8_t {
     Power,
     Data,
-    Ping
+    Ping,
+    // u16 span count, then per span a u16 led offset, u16 led count and the grb bytes
+    Spans,
+    // u16 palette size and the grb palette, then runs covering the whole frame,
+    // pixels are palette indices if there's a palette and grb otherwise
+    Compressed,
+    // asks how many messages the device can take before their pongs come back
+    Credits,
+    // u8 index bits (4 or 8), u8 palette size - 1 and the grb palette, then an index for every led,
+    // two per byte low nibble first with 4 bits. the nano plays them straight from its buffer so no spans on top
+    Indexed,
+    // u8 curve (1 linear, 2 eased, 0 off) with the top bit to fade as light, u16 fades per second at most or 0 for
+    // as many as the strips take. the pico fades into every frame from then on
+    Interpolate = 8,
+    // u32 due time on the device's clock, then a data, spans or compressed message the pico holds until then
+    Timed = 9,
+    // u16 length, u8 sequence, then a message of that length (its type and payload) and the crc-16 of all of it,
+    // the device answers it with a pong on its own
+    Framed = 0xa5
+};
+
+// what the device sends back, multi-byte replies are a type followed by payload bytes with the high bit set
+enum class ReplyType : uint8_t {
+    Pong = 0,
+    Ready = 1,
+    Credits = 0x40,
+    // how many framed messages were rejected or never arrived, none of them get a pong
+    Errors = 0x41,
+    // after every pong from the pico, its microsecond clock as a u32 in 7 bit groups low first
+    Clock = 0x42,
+    // timed frames the pico got too late and too early to hold since the last one
+    Timing = 0x43,
+    // bytes the nano's uart had to drop since the last one, its ring was full or it was writing the strips
+    Lost = 0x44
+};
+
+struct CgsLedZone {
+    std::string name;
+    unsigned int leds;
+    ColorOrder order;
+};
+
+struct CgsLedConfig {
+    std::string port;
+    int baud;
+    unsigned int brightness;
+    // only the pico understands compressed frames, they go out once the device turned out to be one
+    bool compress;
+    // only the nano understands indexed frames
+    bool indexed;
+    bool gamma;
+    // only the pico interpolates, 0 off, 1 linear and 2 eased
+    uint8_t interpolate;
+    unsigned int interpolateRate;
+    // frames are shown this long after they were requested instead of whenever they arrive, so the link's jitter
+    // doesn't make it to the strips. needs the pico's clock, 0 sends them to be shown right away
+    unsigned int delayMs;
+    // updates within one frame interval are collapsed into a single transmission, 0 sends as fast as the link allows
+    unsigned int fps;
+    std::vector<CgsLedZone> zones;
+};
+
+struct CgsLedStats {
+    uint64_t requested;
+    uint64_t sent;
+    // replaced by a newer frame before the writer got to send them
+    uint64_t coalesced;
+    // messages the device rejected or that never got an answer, a link that keeps racking these up wants a lower baud
+    uint64_t errors;
+    // bytes the device received but had to drop, whatever they were part of shows up as errors or a broken frame
+    uint64_t lost;
+    // frames per second the link can sustain, from how long recent frames took to get their pong back
+    double linkFps;
+    uint64_t bytes;
+    // waiting for credits or inside serial writes
+    double blockedSeconds;
+    size_t credits;
+    // from writing a message to its pong
+    LatencyHistogram::Counts latency;
+    // timed frames the device had to show right away
+    uint64_t late;
+    uint64_t early;
+    // the device's clock minus ours, only known once the device sent it, and how far off that can be at most
+    bool clockKnown;
+    int64_t clockOffsetUs;
+    int64_t clockErrorUs;
 };
 
 class CgsLedRgbController : public RGBController {
 public:
-    CgsLedRgbController(const char* port, int baud, unsigned int brightness);
+    CgsLedRgbController(const CgsLedConfig& config);
     ~CgsLedRgbController();
 
     void SetupZones();
@@ -25,8 +124,96 @@ public:
 
     void DeviceUpdateMode();
 
+    CgsLedStats GetStats() const;
+    // location and stats of every controller that's currently alive
+    static std::vector<std::pair<std::string, CgsLedStats>> GetAllStats();
+
 private:
+    void WriterThread();
+    // message points at the type, with room for the frame header in front of it and the crc or ping after it
+    bool Send(char* message, size_t size, bool frame);
+    // writes a message ending in a ping as soon as the device has a credit for it
+    bool Transmit(const char* data, size_t size, bool frame);
+    // how many bytes came in
+    int ReadReplies();
+    // reads what's there or sleeps a bit if nothing is, false once the controller is going away
+    bool WaitForReplies();
+    void HandleReply(uint8_t x);
+    // a pong's round trip against the device's clock in it, the quickest one in a while is the one that counts
+    void AddClockSample(uint32_t device);
+    size_t EncodeSpans(size_t size);
+    size_t EncodeCompressed(size_t size);
+    size_t EncodeIndexed(size_t size);
+
+    static std::mutex s_instancesMutex;
+    static std::vector<CgsLedRgbController*> s_instances;
+
+    CgsLedConfig m_config;
     serial_port* m_serial;
-    char* m_buffer;
-    bool m_canContinue = true;
+
+    // writer side flow control, every message in flight holds one of the device's credits until its pong
+    std::atomic<size_t> m_credits = 1;
+    std::deque<std::pair<std::chrono::steady_clock::time_point, bool>> m_inFlight;
+    std::chrono::steady_clock::time_point m_lastPong;
+    // devices that hand out credits also check framed messages
+    bool m_framed = false;
+    // only the pico sends its clock along with its pongs, and only the pico can decode compressed frames. a nano
+    // would take one for something else entirely and lose track of everything after it
+    bool m_pico = false;
+    uint8_t m_sequence = 0;
+    // something got lost, the device gets a whole frame again
+    bool m_resend = false;
+    // the nano says ready when it comes up, it forgot the mode too then. resending that on every error would restart
+    // freddy each time
+    bool m_deviceReset = false;
+    int m_sentMode = -1;
+    // the pong the next clock reply belongs to
+    std::chrono::steady_clock::time_point m_pongSent;
+    std::chrono::steady_clock::time_point m_pongReceived;
+    // added to our microseconds it's the device's, wrapping along with its u32
+    std::atomic<bool> m_clockKnown = false;
+    std::atomic<uint32_t> m_clockOffset = 0;
+    std::atomic<int64_t> m_clockErrorUs = 0;
+    std::chrono::steady_clock::time_point m_clockWindowStart;
+    std::chrono::steady_clock::duration m_bestRoundTrip = std::chrono::steady_clock::duration::max();
+    uint32_t m_bestOffset = 0;
+    ReplyType m_replyType = ReplyType::Pong;
+    uint8_t m_replyPayload[8];
+    size_t m_replySize = 0;
+
+    // all sized for the whole layout up front, frames never reallocate
+    // writer side, m_sent is what the device currently has and is diffed against to only send changed spans
+    std::vector<char> m_buffer;
+    std::vector<char> m_frame;
+    std::vector<char> m_sent;
+    size_t m_sentSize = 0;
+    bool m_sentIndexed = false;
+    std::vector<char> m_scratch;
+    Compressor m_compressor;
+
+    // latest-frame-wins mailbox, callers publish into m_pending and the writer swaps it with m_frame
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    ColorPacker m_packer;
+    std::vector<char> m_pending;
+    size_t m_pendingSize = 0;
+    // when the frames were requested, which is what the delay counts from
+    std::chrono::steady_clock::time_point m_pendingAt;
+    std::chrono::steady_clock::time_point m_frameAt;
+    bool m_framePending = false;
+    bool m_modePending = false;
+    int m_pendingMode = 0;
+    std::atomic<bool> m_stopping = false;
+    std::atomic<uint64_t> m_requestedFrames = 0;
+    std::atomic<uint64_t> m_sentFrames = 0;
+    std::atomic<uint64_t> m_coalescedFrames = 0;
+    std::atomic<uint64_t> m_errors = 0;
+    std::atomic<uint64_t> m_lost = 0;
+    std::atomic<uint64_t> m_late = 0;
+    std::atomic<uint64_t> m_early = 0;
+    std::atomic<double> m_frameTime = 0.0;
+    std::atomic<uint64_t> m_sentBytes = 0;
+    std::atomic<double> m_blockedSeconds = 0.0;
+    LatencyHistogram m_latency;
+    std::thread m_writer;
 };
@@ -0,0 +1,214 @@
+#include "ColorPacker.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+// the plugin is built for plain x86-64, so avx2 gets compiled in on its own and picked at runtime
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CGSLED_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// msvc takes avx2 intrinsics anywhere
+#define CGSLED_TARGET_AVX2
+#else
+#define CGSLED_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CGSLED_SSE2
+#include <emmintrin.h>
+#endif
+
+// floor(x * brightness / 100) for x * brightness < 25600 as a 16 bit multiply-high and a shift,
+// which is exactly what the lut holds when gamma is off so both paths output the same bytes
+constexpr uint16_t divide100Multiplier = 41944;
+constexpr int divide100Shift = 6;
+
+ColorOrder ColorPacker::ParseOrder(std::string_view order) {
+    ColorOrder res { 1, 0, 2 };
+    if (order.size() != 3)
+        return res;
+    bool seen[3] { };
+    for (size_t i = 0; i < 3; i++) {
+        size_t channel = std::string_view("RGB").find(static_cast<char>(std::toupper(order[i])));
+        if (channel == std::string_view::npos || seen[channel])
+            return { 1, 0, 2 };
+        seen[channel] = true;
+        res[i] = static_cast<uint8_t>(channel);
+    }
+    return res;
+}
+
+void ColorPacker::SetBrightness(unsigned int brightness, bool gamma) {
+    brightness = std::min(brightness, 100u);
+    if (m_built && m_brightness == brightness && m_gamma == gamma)
+        return;
+    m_brightness = brightness;
+    m_gamma = gamma;
+    m_built = true;
+
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int x = i;
+        if (gamma)
+            x = static_cast<unsigned int>(std::lround(std::pow(i / 255.0, 2.2) * 255.0));
+        m_lut[i] = static_cast<uint8_t>(x * brightness / 100);
+    }
+}
+
+ColorPacker::Vector ColorPacker::BestVector() {
+#if defined(CGSLED_AVX2)
+    static const bool avx2 = [] {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        // the os has to save the ymm registers too
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }();
+    if (avx2)
+        return Vector::Avx2;
+#endif
+#if defined(CGSLED_SSE2)
+    return Vector::Sse2;
+#else
+    return Vector::None;
+#endif
+}
+
+const char* ColorPacker::VectorName(Vector vector) {
+    switch (vector) {
+        case Vector::Sse2: return "sse2";
+        case Vector::Avx2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+void ColorPacker::SetVector(Vector vector) {
+    m_vector = std::min(vector, BestVector());
+}
+
+void ColorPacker::Pack(const RGBColor* colors, size_t count, char* out, ColorOrder order) const {
+    size_t done = m_gamma ? 0 : PackVector(colors, count, out, order);
+    PackScalar(colors + done, count - done, out + done * 3, order);
+}
+
+void ColorPacker::PackScalar(const RGBColor* colors, size_t count, char* out, ColorOrder order) const {
+    for (size_t i = 0; i < count; i++) {
+        RGBColor color = colors[i];
+        *out++ = static_cast<char>(m_lut[(color >> (order[0] * 8)) & 0xff]);
+        *out++ = static_cast<char>(m_lut[(color >> (order[1] * 8)) & 0xff]);
+        *out++ = static_cast<char>(m_lut[(color >> (order[2] * 8)) & 0xff]);
+    }
+}
+
+#if defined(CGSLED_AVX2)
+
+CGSLED_TARGET_AVX2
+static size_t packAvx2(const RGBColor* colors, size_t count, char* out, ColorOrder order, unsigned int brightnessValue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i brightness = _mm256_set1_epi16(static_cast<short>(brightnessValue));
+    const __m256i multiplier = _mm256_set1_epi16(static_cast<short>(divide100Multiplier));
+    // rgbx rgbx rgbx rgbx -> e.g. grb grb grb grb in each 128 bit lane
+    alignas(32) int8_t shuffle[32];
+    for (int i = 0; i < 16; i++) {
+        int8_t index = i < 12 ? static_cast<int8_t>(i / 3 * 4 + order[i % 3]) : -1;
+        shuffle[i] = index;
+        shuffle[i + 16] = index;
+    }
+    const __m256i reorder = _mm256_load_si256(reinterpret_cast<const __m256i*>(shuffle));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&colors[i]));
+        __m256i lo = _mm256_unpacklo_epi8(x, zero);
+        __m256i hi = _mm256_unpackhi_epi8(x, zero);
+        lo = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_mullo_epi16(lo, brightness), multiplier), divide100Shift);
+        hi = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_mullo_epi16(hi, brightness), multiplier), divide100Shift);
+        x = _mm256_shuffle_epi8(_mm256_packus_epi16(lo, hi), reorder);
+
+        for (__m128i lane : { _mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1) }) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), lane);
+            uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(lane, 8)));
+            memcpy(out + 8, &tail, 4);
+            out += 12;
+        }
+    }
+    return i;
+}
+
+#endif
+
+#if defined(CGSLED_SSE2)
+
+// word shuffles need the order as an immediate
+template<int Order>
+static size_t packSse2Order(const RGBColor* colors, size_t count, char* out, unsigned int brightnessValue) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i brightness = _mm_set1_epi16(static_cast<short>(brightnessValue));
+    const __m128i multiplier = _mm_set1_epi16(static_cast<short>(divide100Multiplier));
+
+    // low 3 bytes of each pixel in a 64 bit half, and the 3 bytes of the second pixel right after them
+    const __m128i first = _mm_set1_epi64x(0x0000000000ffffff);
+    const __m128i second = _mm_set1_epi64x(0x0000ffffff000000);
+    const __m128i low = _mm_set_epi32(0, 0, -1, -1);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&colors[i]));
+        __m128i lo = _mm_unpacklo_epi8(x, zero);
+        __m128i hi = _mm_unpackhi_epi8(x, zero);
+        lo = _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(lo, brightness), multiplier), divide100Shift);
+        hi = _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(hi, brightness), multiplier), divide100Shift);
+        // no byte shuffles before ssse3 so reorder the channels while they're still words
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, Order), Order);
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, Order), Order);
+        x = _mm_packus_epi16(lo, hi);
+
+        // squeeze out the 4th byte, 6 bytes per half and then both halves next to each other
+        x = _mm_or_si128(_mm_and_si128(x, first), _mm_and_si128(_mm_srli_epi64(x, 8), second));
+        x = _mm_or_si128(_mm_and_si128(x, low), _mm_slli_si128(_mm_srli_si128(x, 8), 6));
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), x);
+        uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x, 8)));
+        memcpy(out + 8, &tail, 4);
+        out += 12;
+    }
+    return i;
+}
+
+static size_t packSse2(const RGBColor* colors, size_t count, char* out, ColorOrder order, unsigned int brightness) {
+    switch (order[0] | order[1] << 2 | order[2] << 4) {
+        case 0 | 1 << 2 | 2 << 4: return packSse2Order<_MM_SHUFFLE(3, 2, 1, 0)>(colors, count, out, brightness);
+        case 0 | 2 << 2 | 1 << 4: return packSse2Order<_MM_SHUFFLE(3, 1, 2, 0)>(colors, count, out, brightness);
+        case 1 | 0 << 2 | 2 << 4: return packSse2Order<_MM_SHUFFLE(3, 2, 0, 1)>(colors, count, out, brightness);
+        case 1 | 2 << 2 | 0 << 4: return packSse2Order<_MM_SHUFFLE(3, 0, 2, 1)>(colors, count, out, brightness);
+        case 2 | 0 << 2 | 1 << 4: return packSse2Order<_MM_SHUFFLE(3, 1, 0, 2)>(colors, count, out, brightness);
+        case 2 | 1 << 2 | 0 << 4: return packSse2Order<_MM_SHUFFLE(3, 0, 1, 2)>(colors, count, out, brightness);
+        default: return 0;
+    }
+}
+
+#endif
+
+size_t ColorPacker::PackVector(const RGBColor* colors, size_t count, char* out, ColorOrder order) const {
+    switch (m_vector) {
+#if defined(CGSLED_AVX2)
+        case Vector::Avx2: return packAvx2(colors, count, out, order, m_brightness);
+#endif
+#if defined(CGSLED_SSE2)
+        case Vector::Sse2: return packSse2(colors, count, out, order, m_brightness);
+#endif
+        default: return 0;
+    }
+}
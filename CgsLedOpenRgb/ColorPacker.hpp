@@ -0,0 +1,45 @@
+#pragma once
+
+#include "RGBController.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// which channel (r=0, g=1, b=2) goes into each of the 3 bytes sent for a led
+using ColorOrder = std::array<uint8_t, 3>;
+
+// converts openrgb colors to the bytes the strips expect with brightness (and optionally gamma) applied
+class ColorPacker {
+public:
+    // the vector paths without gamma, better ones later
+    enum class Vector : uint8_t {
+        None,
+        Sse2,
+        Avx2
+    };
+    // the best one this cpu runs, which every packer starts out with
+    static Vector BestVector();
+    static const char* VectorName(Vector vector);
+    // for the benchmark, anything past BestVector falls back to it
+    void SetVector(Vector vector);
+
+    // "GRB", "RGB" etc., anything that isn't a permutation of rgb falls back to grb
+    static ColorOrder ParseOrder(std::string_view order);
+
+    // rebuilds the lut only if something actually changed
+    void SetBrightness(unsigned int brightness, bool gamma);
+
+    // writes count * 3 bytes to out
+    void Pack(const RGBColor* colors, size_t count, char* out, ColorOrder order) const;
+
+private:
+    void PackScalar(const RGBColor* colors, size_t count, char* out, ColorOrder order) const;
+    size_t PackVector(const RGBColor* colors, size_t count, char* out, ColorOrder order) const;
+
+    unsigned int m_brightness = 0;
+    bool m_gamma = false;
+    bool m_built = false;
+    uint8_t m_lut[256];
+    Vector m_vector = BestVector();
+};
@@ -0,0 +1,127 @@
+#include "Compressor.hpp"
+#include <algorithm>
+#include <cstring>
+
+// a header byte followed by pixels, high bit set means a run of one pixel repeated,
+// otherwise it's a literal of that many different pixels. only measures when out is null
+static size_t encodeRuns(const char* pixels, size_t count, size_t width, char* out) {
+    constexpr size_t maxLength = 128;
+    auto same = [&](size_t a, size_t b) {
+        return memcmp(&pixels[a * width], &pixels[b * width], width) == 0;
+    };
+
+    size_t off = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && run < maxLength && same(i, i + run))
+            run++;
+        if (run >= 2) {
+            if (out) {
+                out[off] = static_cast<char>(0x80 | (run - 1));
+                memcpy(&out[off + 1], &pixels[i * width], width);
+            }
+            off += 1 + width;
+            i += run;
+            continue;
+        }
+
+        size_t length = 1;
+        while (i + length < count && length < maxLength &&
+            !(i + length + 1 < count && same(i + length, i + length + 1)))
+            length++;
+        if (out) {
+            out[off] = static_cast<char>(length - 1);
+            memcpy(&out[off + 1], &pixels[i * width], length * width);
+        }
+        off += 1 + length * width;
+        i += length;
+    }
+    return off;
+}
+
+static void writeU16(char* buffer, size_t& off, size_t value) {
+    buffer[off++] = static_cast<char>(value & 0xff);
+    buffer[off++] = static_cast<char>((value >> 8) & 0xff);
+}
+
+void Compressor::Reserve(size_t ledCount) {
+    m_indices.resize(ledCount);
+    m_palette.reserve(256);
+}
+
+bool Compressor::BuildPalette(const char* frame, size_t ledCount, char* palette) {
+    // indices only fit in a byte as long as the frame has at most 256 different colors
+    m_indices.resize(std::max(m_indices.size(), ledCount));
+    m_palette.clear();
+    for (size_t i = 0; i < ledCount; i++) {
+        uint32_t color = 0;
+        memcpy(&color, &frame[i * 3], 3);
+        auto found = m_palette.find(color);
+        if (found != m_palette.end()) {
+            m_indices[i] = static_cast<char>(found->second);
+            continue;
+        }
+        if (m_palette.size() == 256)
+            return false;
+        uint8_t index = static_cast<uint8_t>(m_palette.size());
+        m_palette.emplace(color, index);
+        memcpy(&palette[index * 3], &frame[i * 3], 3);
+        m_indices[i] = static_cast<char>(index);
+    }
+    return true;
+}
+
+size_t Compressor::Encode(const char* frame, size_t size, char* out) {
+    const size_t ledCount = size / 3;
+
+    // the palette goes right where it'd be sent, it's only left out again if the plain runs come out smaller
+    bool usePalette = BuildPalette(frame, ledCount, &out[2]);
+    size_t plainSize = 2 + encodeRuns(frame, ledCount, 3, nullptr);
+    size_t paletteSize = usePalette ?
+        2 + m_palette.size() * 3 + encodeRuns(m_indices.data(), ledCount, 1, nullptr) :
+        SIZE_MAX;
+    if (std::min(plainSize, paletteSize) >= size)
+        return 0;
+
+    size_t off = 0;
+    if (paletteSize < plainSize) {
+        writeU16(out, off, m_palette.size());
+        off += m_palette.size() * 3;
+        off += encodeRuns(m_indices.data(), ledCount, 1, &out[off]);
+    }
+    else {
+        writeU16(out, off, 0);
+        off += encodeRuns(frame, ledCount, 3, &out[off]);
+    }
+    return off;
+}
+
+size_t Compressor::EncodeIndexed(const char* frame, size_t size, char* out) {
+    const size_t ledCount = size / 3;
+    if (ledCount == 0 || !BuildPalette(frame, ledCount, &out[2]))
+        return 0;
+    // the nano keeps the indices and the palette behind them in the space of a frame of plain colors
+    const size_t colors = PaletteCount();
+    const size_t bits = colors <= 16 ? 4 : 8;
+    const size_t indexSize = bits == 4 ? (ledCount + 1) / 2 : ledCount;
+    const size_t paletteSize = colors * 3;
+    if (indexSize + paletteSize > size || 2 + paletteSize + indexSize >= size)
+        return 0;
+
+    size_t off = 0;
+    out[off++] = static_cast<char>(bits);
+    out[off++] = static_cast<char>(colors - 1);
+    off += paletteSize;
+    if (bits == 8) {
+        memcpy(&out[off], m_indices.data(), ledCount);
+    }
+    else {
+        for (size_t i = 0; i < ledCount; i += 2) {
+            uint8_t lo = static_cast<uint8_t>(m_indices[i]);
+            uint8_t hi = i + 1 < ledCount ? static_cast<uint8_t>(m_indices[i + 1]) : 0;
+            out[off + i / 2] = static_cast<char>(lo | (hi << 4));
+        }
+    }
+    return off + indexSize;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// the payload of compressed frames and the palette indexed ones share, doesn't need OpenRGB so the emulator's
+// tests can check it against the firmware's decoding
+class Compressor {
+public:
+    void Reserve(size_t ledCount);
+
+    // indices of every led into Indices() and its colors into palette, false with more than 256 of them
+    bool BuildPalette(const char* frame, size_t ledCount, char* palette);
+    size_t PaletteCount() const { return m_palette.size(); }
+    const char* Indices() const { return m_indices.data(); }
+
+    // u16 palette size, the palette and the runs into out, everything but the type. 0 if that isn't smaller than
+    // the frame's bytes, out has to have room for those
+    size_t Encode(const char* frame, size_t size, char* out);
+
+    // index bits, palette size - 1, the palette and an index for every led (4 bits, two per byte low nibble first
+    // with 16 colors or less), everything but the type. 0 with too many colors or if that isn't smaller than the
+    // frame or doesn't fit where the nano keeps a frame of plain colors, out has to have room for size + 2 bytes
+    size_t EncodeIndexed(const char* frame, size_t size, char* out);
+
+private:
+    std::vector<char> m_indices;
+    std::unordered_map<uint32_t, uint8_t> m_palette;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// log-scale buckets from 1us to ~16s, 8 per octave so any percentile is within ~9% of the real value
+class LatencyHistogram {
+public:
+    static constexpr size_t bucketsPerOctave = 8;
+    static constexpr size_t bucketCount = 24 * bucketsPerOctave;
+    using Counts = std::array<uint64_t, bucketCount>;
+
+    void Add(double seconds) {
+        double us = seconds * 1000000.0;
+        size_t bucket = 0;
+        if (us > 1.0)
+            bucket = std::min(static_cast<size_t>(std::log2(us) * bucketsPerOctave), bucketCount - 1);
+        m_buckets[bucket]++;
+    }
+
+    Counts Snapshot() const {
+        Counts res;
+        for (size_t i = 0; i < bucketCount; i++)
+            res[i] = m_buckets[i];
+        return res;
+    }
+
+    // upper edge of the bucket in seconds
+    static double BucketLimit(size_t bucket) {
+        return std::exp2(static_cast<double>(bucket + 1) / bucketsPerOctave) / 1000000.0;
+    }
+
+    // p in [0, 1], 0 if there are no samples
+    static double Percentile(const Counts& counts, double p) {
+        uint64_t total = 0;
+        for (uint64_t count : counts)
+            total += count;
+        if (total == 0)
+            return 0.0;
+        uint64_t target = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucketCount; i++) {
+            seen += counts[i];
+            if (seen >= target && seen > 0)
+                return BucketLimit(i);
+        }
+        return BucketLimit(bucketCount - 1);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucketCount> m_buckets {};
+};
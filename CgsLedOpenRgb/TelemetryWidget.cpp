@@ -0,0 +1,141 @@
+#include "TelemetryWidget.hpp"
+#include "CgsLedOpenRgb.hpp"
+#include <QPushButton>
+#include <QVBoxLayout>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+TelemetryWidget::TelemetryWidget(QWidget* parent) : QWidget(parent) {
+    QVBoxLayout* layout = new QVBoxLayout();
+    setLayout(layout);
+
+    m_label = new QLabel("Waiting for devices...");
+    m_label->setTextFormat(Qt::RichText);
+    m_label->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+    layout->addWidget(m_label);
+
+    QPushButton* save = new QPushButton("Save snapshot");
+    connect(save, &QPushButton::clicked, this, [this] { SaveSnapshot(); });
+    layout->addWidget(save);
+
+    m_status = new QLabel();
+    layout->addWidget(m_status);
+    layout->addStretch();
+
+    m_timer = new QTimer(this);
+    connect(m_timer, &QTimer::timeout, this, [this] { Refresh(); });
+    m_timer->start(1000);
+}
+
+void TelemetryWidget::Refresh() {
+    auto now = std::chrono::steady_clock::now();
+    m_latest.clear();
+    for (const auto& [location, stats] : CgsLedRgbController::GetAllStats()) {
+        CgsLedTelemetry telemetry { };
+        telemetry.location = location;
+        telemetry.totals = stats;
+
+        auto previous = m_previous.find(location);
+        if (previous != m_previous.end()) {
+            const auto& [then, last] = previous->second;
+            double seconds = std::chrono::duration<double>(now - then).count();
+            LatencyHistogram::Counts latency;
+            for (size_t i = 0; i < LatencyHistogram::bucketCount; i++)
+                latency[i] = stats.latency[i] - last.latency[i];
+            telemetry.framesPerSecond = (stats.sent - last.sent) / seconds;
+            telemetry.bytesPerSecond = (stats.bytes - last.bytes) / seconds;
+            telemetry.blocked = (stats.blockedSeconds - last.blockedSeconds) / seconds;
+            telemetry.latencyP50 = LatencyHistogram::Percentile(latency, 0.5);
+            telemetry.latencyP99 = LatencyHistogram::Percentile(latency, 0.99);
+            telemetry.latencyMax = LatencyHistogram::Percentile(latency, 1.0);
+        }
+        m_previous[location] = { now, stats };
+        m_latest.push_back(telemetry);
+    }
+
+    if (m_latest.empty()) {
+        m_label->setText("Waiting for devices...");
+        return;
+    }
+
+    QString text;
+    for (const auto& telemetry : m_latest) {
+        const auto& totals = telemetry.totals;
+        text += QString("<b>%1</b><br>").arg(QString::fromStdString(telemetry.location));
+        text += QString("%1 fps, %2 KiB/s (link sustains %3 fps, %4 credits)<br>")
+            .arg(telemetry.framesPerSecond, 0, 'f', 1)
+            .arg(telemetry.bytesPerSecond / 1024.0, 0, 'f', 1)
+            .arg(totals.linkFps, 0, 'f', 1)
+            .arg(totals.credits);
+        text += QString("pong latency p50 %1 ms, p99 %2 ms, max %3 ms<br>")
+            .arg(telemetry.latencyP50 * 1000.0, 0, 'f', 2)
+            .arg(telemetry.latencyP99 * 1000.0, 0, 'f', 2)
+            .arg(telemetry.latencyMax * 1000.0, 0, 'f', 2);
+        text += QString("blocked on serial %1%<br>")
+            .arg(telemetry.blocked * 100.0, 0, 'f', 1);
+        text += QString("frames requested %1, sent %2, coalesced %3<br>")
+            .arg(totals.requested)
+            .arg(totals.sent)
+            .arg(totals.coalesced);
+        text += QString("link errors %1, bytes the device dropped %2<br>")
+            .arg(totals.errors)
+            .arg(totals.lost);
+        if (totals.clockKnown) {
+            text += QString("device clock %1 ms ahead (within %2 ms), timed frames late %3, early %4<br>")
+                .arg(totals.clockOffsetUs / 1000.0, 0, 'f', 3)
+                .arg(totals.clockErrorUs / 1000.0, 0, 'f', 3)
+                .arg(totals.late)
+                .arg(totals.early);
+        }
+        text += "<br>";
+    }
+    m_label->setText(text);
+}
+
+nlohmann::json TelemetryWidget::ToJson(const CgsLedTelemetry& telemetry) {
+    const auto& totals = telemetry.totals;
+    return {
+        { "location", telemetry.location },
+        { "framesPerSecond", telemetry.framesPerSecond },
+        { "bytesPerSecond", telemetry.bytesPerSecond },
+        { "blocked", telemetry.blocked },
+        { "latency", {
+            { "p50", telemetry.latencyP50 },
+            { "p99", telemetry.latencyP99 },
+            { "max", telemetry.latencyMax },
+            { "totalP50", LatencyHistogram::Percentile(totals.latency, 0.5) },
+            { "totalP99", LatencyHistogram::Percentile(totals.latency, 0.99) },
+            { "totalMax", LatencyHistogram::Percentile(totals.latency, 1.0) }
+        } },
+        { "linkFps", totals.linkFps },
+        { "credits", totals.credits },
+        { "requested", totals.requested },
+        { "sent", totals.sent },
+        { "coalesced", totals.coalesced },
+        { "errors", totals.errors },
+        { "lost", totals.lost },
+        { "bytes", totals.bytes },
+        { "blockedSeconds", totals.blockedSeconds },
+        { "late", totals.late },
+        { "early", totals.early },
+        { "clockKnown", totals.clockKnown },
+        { "clockOffsetUs", totals.clockOffsetUs },
+        { "clockErrorUs", totals.clockErrorUs }
+    };
+}
+
+void TelemetryWidget::SaveSnapshot() {
+    nlohmann::json devices = nlohmann::json::array();
+    for (const auto& telemetry : m_latest)
+        devices.push_back(ToJson(telemetry));
+
+    std::filesystem::path path = std::filesystem::path(CgsLedOpenRgb::s_res->GetConfigurationDirectory()) / "CgsLedTelemetry.json";
+    std::ofstream file(path);
+    if (!file) {
+        m_status->setText(QString("Couldn't write %1").arg(QString::fromStdString(path.string())));
+        return;
+    }
+    file << nlohmann::json({ { "devices", devices } }).dump(4);
+    m_status->setText(QString("Saved to %1").arg(QString::fromStdString(path.string())));
+}
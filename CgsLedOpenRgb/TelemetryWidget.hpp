@@ -0,0 +1,40 @@
+#pragma once
+
+#include "CgsLedRgbController.hpp"
+#include <QLabel>
+#include <QTimer>
+#include <QWidget>
+#include <chrono>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one device's link over the last refresh interval
+struct CgsLedTelemetry {
+    std::string location;
+    double framesPerSecond;
+    double bytesPerSecond;
+    // fraction of the interval the writer spent waiting on the serial port
+    double blocked;
+    double latencyP50;
+    double latencyP99;
+    double latencyMax;
+    CgsLedStats totals;
+};
+
+class TelemetryWidget : public QWidget {
+public:
+    TelemetryWidget(QWidget* parent = nullptr);
+
+private:
+    void Refresh();
+    void SaveSnapshot();
+    static nlohmann::json ToJson(const CgsLedTelemetry& telemetry);
+
+    QLabel* m_label;
+    QLabel* m_status;
+    QTimer* m_timer;
+    std::unordered_map<std::string, std::pair<std::chrono::steady_clock::time_point, CgsLedStats>> m_previous;
+    std::vector<CgsLedTelemetry> m_latest;
+};
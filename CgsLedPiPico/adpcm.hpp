@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ima adpcm, 4 bits per sample low nibble first and no block headers since it only ever plays from the start.
+// the encoder tracks the exact same state the decoder will have so the error can't drift
+namespace adpcm {
+    constexpr int16_t stepTable[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+        337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+        2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+    constexpr int8_t indexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+    struct State {
+        int32_t predictor = 0;
+        int32_t index = 0;
+
+        int16_t decode(uint8_t nibble) {
+            int32_t step = stepTable[index];
+            int32_t diff = step >> 3;
+            if (nibble & 4)
+                diff += step;
+            if (nibble & 2)
+                diff += step >> 1;
+            if (nibble & 1)
+                diff += step >> 2;
+            predictor += nibble & 8 ? -diff : diff;
+            predictor = predictor < -32768 ? -32768 : predictor > 32767 ? 32767 : predictor;
+            index += indexTable[nibble & 7];
+            index = index < 0 ? 0 : index > 88 ? 88 : index;
+            return static_cast<int16_t>(predictor);
+        }
+
+        uint8_t encode(int16_t sample) {
+            int32_t step = stepTable[index];
+            int32_t diff = sample - predictor;
+            uint8_t nibble = 0;
+            if (diff < 0) {
+                nibble = 8;
+                diff = -diff;
+            }
+            if (diff >= step) {
+                nibble |= 4;
+                diff -= step;
+            }
+            if (diff >= step >> 1) {
+                nibble |= 2;
+                diff -= step >> 1;
+            }
+            if (diff >= step >> 2)
+                nibble |= 1;
+            decode(nibble);
+            return nibble;
+        }
+    };
+
+    // streams unsigned 8 bit samples straight out of flash, a few bytes of state no matter how long the clip is
+    class Decoder {
+    public:
+        Decoder() = default;
+        Decoder(const uint8_t* data, size_t samples) : m_data(data), m_samples(samples) { }
+
+        size_t decode(uint8_t* out, size_t count) {
+            size_t i = 0;
+            for (; i < count && m_position < m_samples; i++, m_position++) {
+                uint8_t byte = m_data[m_position / 2];
+                int16_t sample = m_state.decode(m_position & 1 ? byte >> 4 : byte & 0x0f);
+                out[i] = static_cast<uint8_t>((sample >> 8) + 128);
+            }
+            return i;
+        }
+
+        bool done() const {
+            return m_position >= m_samples;
+        }
+
+    private:
+        const uint8_t* m_data = nullptr;
+        size_t m_samples = 0;
+        size_t m_position = 0;
+        State m_state;
+    };
+}
@@ -1,5 +1,4 @@
 #include <array>
-#include <queue>
 #include <string.h>
 
 #include "pico/stdlib.h"
@@ -10,6 +9,7 @@
 #include "hardware/clocks.h"
 
 #include "audio.hpp"
+#include "ring.hpp"
 
 #define REPETITION_RATE 4
 
@@ -23,7 +23,8 @@ uint8_t buffers[2][AUDIO_BUFFER_SIZE];
 volatile int currBuf = 0;
 volatile int lastBuf = 0;
 
-std::queue<uint8_t> audioSamples;
+// a few buffers worth, whoever decodes only tops it up after step() took a buffer out
+Ring<AUDIO_BUFFER_SIZE * 4> audioSamples;
 
 static void __isr __time_critical_func(dma_handler)() {
     currBuf = 1 - currBuf;
@@ -109,18 +110,14 @@ uint8_t* audio::getBuffer() {
     return buf;
 }
 
-void audio::addSamples(const uint8_t* samples, size_t count) {
-    for (size_t i = 0; i < count; i++)
-        audioSamples.push(samples[i]);
+size_t audio::addSamples(const uint8_t* samples, size_t count) {
+    return audioSamples.write(samples, count);
 }
 
 void audio::stop() {
-    while (!audioSamples.empty())
-        audioSamples.pop();
-    for (int i = 0; i < AUDIO_BUFFER_SIZE; i++) {
-        buffers[0][i] = 0;
-        buffers[1][i] = 0;
-    }
+    audioSamples.clear();
+    memset(buffers[0], 0, AUDIO_BUFFER_SIZE);
+    memset(buffers[1], 0, AUDIO_BUFFER_SIZE);
 }
 
 bool audio::step() {
@@ -128,14 +125,7 @@ bool audio::step() {
     if (!buffer)
         return false;
 
-    for (int i = 0; i < AUDIO_BUFFER_SIZE; i++) {
-        if (audioSamples.empty()) {
-            buffer[i] = 0;
-            continue;
-        }
-        buffer[i] = audioSamples.front();
-        audioSamples.pop();
-    }
-
+    size_t count = audioSamples.read(buffer, AUDIO_BUFFER_SIZE);
+    memset(buffer + count, 0, AUDIO_BUFFER_SIZE - count);
     return true;
 }
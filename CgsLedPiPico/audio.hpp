@@ -2,12 +2,14 @@
 
 #define AUDIO_BUFFER_SIZE 1024
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace audio {
     void init(int pin, int frequency);
     uint8_t* getBuffer();
-    void addSamples(const uint8_t* samples, size_t count);
+    // safe from another core or an irq than step() and stop(), returns how many fit
+    size_t addSamples(const uint8_t* samples, size_t count);
     void stop();
     bool step();
 }
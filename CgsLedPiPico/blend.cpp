@@ -0,0 +1,66 @@
+#include "blend.hpp"
+
+#include <array>
+#include <cmath>
+
+namespace {
+    // 2.2 like LedBuffer.cs but in 0.20 so even the darkest steps stay apart, worked out once at startup
+    const std::array<uint32_t, 256> toLinear = [] {
+        std::array<uint32_t, 256> res;
+        for (size_t i = 0; i < 256; i++)
+            res[i] = static_cast<uint32_t>(std::lround(std::pow(i / 255.0, 2.2) * (1 << 20)));
+        return res;
+    }();
+
+    // the least light that's closer to i than to i - 1
+    const std::array<uint32_t, 256> boundaries = [] {
+        std::array<uint32_t, 256> res;
+        res[0] = 0;
+        for (size_t i = 1; i < 256; i++)
+            res[i] = (toLinear[i - 1] + toLinear[i] + 1) / 2;
+        return res;
+    }();
+
+    uint8_t fromLinear(uint32_t light) {
+        uint32_t res = 0;
+        for (uint32_t step = 128; step > 0; step >>= 1) {
+            if (boundaries[res + step] <= light)
+                res += step;
+        }
+        return static_cast<uint8_t>(res);
+    }
+}
+
+blend::Params blend::parse(const uint8_t* data) {
+    Params res;
+    res.curve = static_cast<Curve>(data[0] & 0x7f);
+    res.linearLight = data[0] & 0x80;
+    res.rate = static_cast<uint16_t>(data[1] | (data[2] << 8));
+    return res;
+}
+
+uint16_t blend::shape(Curve curve, uint16_t progress) {
+    const uint32_t p = progress > 256 ? 256 : progress;
+    if (curve == Curve::Eased)
+        return static_cast<uint16_t>((p * p * (3 * 256 - 2 * p)) >> 16);
+    return static_cast<uint16_t>(p);
+}
+
+void blend::mix(const uint8_t* from, const uint8_t* to, uint8_t* out, size_t size, uint16_t weight, bool linearLight) {
+    const int32_t w = weight > 256 ? 256 : weight;
+    if (!linearLight) {
+        for (size_t i = 0; i < size; i++)
+            out[i] = static_cast<uint8_t>(from[i] + (((to[i] - from[i]) * w + 128) >> 8));
+        return;
+    }
+    for (size_t i = 0; i < size; i++) {
+        // most of a frame usually sits still, those skip the search
+        if (from[i] == to[i]) {
+            out[i] = from[i];
+            continue;
+        }
+        const int32_t a = static_cast<int32_t>(toLinear[from[i]]);
+        const int32_t b = static_cast<int32_t>(toLinear[to[i]]);
+        out[i] = fromLinear(static_cast<uint32_t>(a + (((b - a) * w + 128) >> 8)));
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// crossfading between frames for the interpolation, portable like effects.hpp (see host/)
+namespace blend {
+    enum class Curve : uint8_t {
+        // frames go out as they come
+        None,
+        Linear,
+        // smoothstep, eases in and out of every frame
+        Eased
+    };
+
+    struct Params {
+        Curve curve = Curve::None;
+        // mixes the colors as light instead of as bytes, for hosts that send colors without gamma correction
+        bool linearLight = false;
+        // frames a second at most, 0 for as fast as the strips go
+        uint16_t rate = 0;
+    };
+
+    // u8 curve with the top bit for linear light, u16 rate
+    constexpr size_t paramsSize = 3;
+    Params parse(const uint8_t* data);
+
+    // how far along the fade is to how much of the new frame shows, both 0 to 256
+    uint16_t shape(Curve curve, uint16_t progress);
+
+    // from and to mixed by weight, 0 to 256. 0 and 256 give back exactly from and to
+    void mix(const uint8_t* from, const uint8_t* to, uint8_t* out, size_t size, uint16_t weight, bool linearLight);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// crc-16/ccitt-false (poly 0x1021, init 0xffff, no reflection), one table lookup per byte
+namespace crc {
+    constexpr uint16_t init = 0xffff;
+
+    constexpr std::array<uint16_t, 256> table = [] {
+        std::array<uint16_t, 256> res { };
+        for (size_t i = 0; i < 256; i++) {
+            uint16_t crc = static_cast<uint16_t>(i << 8);
+            for (int bit = 0; bit < 8; bit++)
+                crc = crc & 0x8000 ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+            res[i] = crc;
+        }
+        return res;
+    }();
+
+    inline uint16_t update(uint16_t crc, const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; i++)
+            crc = static_cast<uint16_t>((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+        return crc;
+    }
+}
@@ -0,0 +1,214 @@
+#include "effects.hpp"
+
+namespace {
+    // Ken Perlin's, same as Perlin.cs. indices wrap instead of doubling the table
+    constexpr uint8_t permutation[256] = {
+        151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37,
+        240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177,
+        33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166, 77, 146,
+        158, 231, 83, 111, 229, 122, 60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25,
+        63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100,
+        109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207, 206,
+        59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153,
+        101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246,
+        97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107, 49, 192,
+        214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114,
+        67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
+    };
+
+    // 2.2, LedBuffer.cs
+    constexpr uint8_t gamma8[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2,
+        3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6,
+        6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10, 11, 11, 11, 12,
+        12, 13, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19,
+        20, 20, 21, 22, 22, 23, 23, 24, 25, 25, 26, 26, 27, 28, 28, 29,
+        30, 30, 31, 32, 33, 33, 34, 35, 35, 36, 37, 38, 39, 39, 40, 41,
+        42, 43, 43, 44, 45, 46, 47, 48, 49, 49, 50, 51, 52, 53, 54, 55,
+        56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+        73, 74, 75, 76, 77, 78, 79, 81, 82, 83, 84, 85, 87, 88, 89, 90,
+        91, 93, 94, 95, 97, 98, 99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+        113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+        137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+        163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+        192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+        223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+    };
+
+    constexpr int32_t one = 1 << 16;
+
+    int32_t hash(int32_t i) {
+        return permutation[i & 255];
+    }
+
+    // everything from here on stays within 32 bits, there's no 64 bit multiply on the m0+.
+    // weights are 4.12 so a difference of up to 4 in 16.16 times one still fits
+    int32_t fade(int32_t t) {
+        int32_t t12 = t >> 4;
+        int32_t r = t12 * 6 - 15 * 4096;
+        r = ((r * t12) >> 12) + 10 * 4096;
+        r = (r * t12) >> 12;
+        r = (r * t12) >> 12;
+        return (r * t12) >> 12;
+    }
+
+    int32_t lerp(int32_t a, int32_t b, int32_t weight) {
+        return a + (((b - a) * weight) >> 12);
+    }
+
+    int32_t gradient(int32_t hash, int32_t x, int32_t y, int32_t z) {
+        int32_t h = hash & 0b1111;
+        int32_t u = h < 0b1000 ? x : y;
+        int32_t v = h < 0b0100 ? y : h == 0b1100 || h == 0b1110 ? x : z;
+        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+    }
+
+    // noise coordinates repeat every 256 anyway so only the low 24 bits matter, which also lets them overflow
+    int32_t wrap(uint32_t x) {
+        return static_cast<int32_t>(x & ((256u << 16) - 1));
+    }
+
+    std::array<uint8_t, 3> mix(const std::array<uint8_t, 3>& a, const std::array<uint8_t, 3>& b, uint32_t weight) {
+        std::array<uint8_t, 3> res;
+        for (size_t i = 0; i < 3; i++)
+            res[i] = static_cast<uint8_t>(a[i] + (((b[i] - a[i]) * static_cast<int32_t>(weight)) >> 8));
+        return res;
+    }
+
+    // whatever only depends on the time, worked out once a frame
+    struct Frame {
+        // 16.16 for the noise
+        uint32_t time;
+        // 8.8 leds, already within the effect's period
+        uint32_t offset;
+        // fire's hue noise is 0.4 as dense as its value noise
+        uint32_t hueScale;
+    };
+
+    Frame frame(const effects::Params& params, uint32_t timeMs) {
+        using effects::Effect;
+        Frame res { };
+        // speed is 8.8 units per second
+        const uint64_t time8 = static_cast<uint64_t>(timeMs) * params.speed / 1000;
+        res.time = static_cast<uint32_t>(static_cast<uint64_t>(timeMs) * params.speed * 256 / 1000);
+        if (params.effect == Effect::Gradient && params.scale > 0)
+            res.offset = static_cast<uint32_t>(time8 % (params.scale * 2u));
+        else if (params.effect == Effect::Chase && params.scale > 0)
+            res.offset = params.scale - static_cast<uint32_t>(time8 % params.scale);
+        res.hueScale = params.scale * 512u / 5;
+        return res;
+    }
+
+    std::array<uint8_t, 3> color(const effects::Params& params, const Frame& frame, uint32_t led) {
+        using effects::Effect;
+        switch (params.effect) {
+            case Effect::Noise: {
+                uint16_t value = effects::perlin(wrap(led * params.scale << 8), 0, wrap(frame.time));
+                return mix(params.from, params.to, value >> 8);
+            }
+            case Effect::Fire: {
+                uint16_t value = effects::perlin(wrap(led * params.scale << 8), 0, wrap(frame.time));
+                // and half as fast
+                uint16_t hue = effects::perlin(wrap(led * frame.hueScale), wrap(frame.time / 2), 0);
+                auto res = effects::hsv(static_cast<uint16_t>(static_cast<uint32_t>(hue) * params.size >> 16), 255, value >> 8);
+                for (auto& x : res)
+                    x = effects::gamma(x);
+                return res;
+            }
+            case Effect::Gradient: {
+                if (params.scale == 0)
+                    return params.from;
+                // there and back so it doesn't jump
+                uint32_t period = params.scale * 2u;
+                uint32_t phase = (led * 256 + frame.offset) % period;
+                if (phase >= params.scale)
+                    phase = period - phase;
+                return mix(params.from, params.to, phase * 256 / params.scale);
+            }
+            case Effect::Chase: {
+                if (params.scale == 0)
+                    return params.from;
+                uint32_t phase = (led * 256 + frame.offset) % params.scale;
+                return phase < params.size * 256u ? params.from : params.to;
+            }
+            default:
+                return { };
+        }
+    }
+}
+
+effects::Params effects::parse(const uint8_t* data) {
+    Params res;
+    res.effect = static_cast<Effect>(data[0]);
+    res.speed = static_cast<uint16_t>(data[1] | (data[2] << 8));
+    res.scale = static_cast<uint16_t>(data[3] | (data[4] << 8));
+    res.size = static_cast<uint16_t>(data[5] | (data[6] << 8));
+    res.from = { data[7], data[8], data[9] };
+    res.to = { data[10], data[11], data[12] };
+    return res;
+}
+
+uint16_t effects::perlin(int32_t x, int32_t y, int32_t z) {
+    int32_t xi = (x >> 16) & 255;
+    int32_t yi = (y >> 16) & 255;
+    int32_t zi = (z >> 16) & 255;
+    int32_t xf = x & (one - 1);
+    int32_t yf = y & (one - 1);
+    int32_t zf = z & (one - 1);
+    int32_t u = fade(xf);
+    int32_t v = fade(yf);
+    int32_t w = fade(zf);
+
+    int32_t aaa = hash(hash(hash(xi) + yi) + zi);
+    int32_t aba = hash(hash(hash(xi) + yi + 1) + zi);
+    int32_t aab = hash(hash(hash(xi) + yi) + zi + 1);
+    int32_t abb = hash(hash(hash(xi) + yi + 1) + zi + 1);
+    int32_t baa = hash(hash(hash(xi + 1) + yi) + zi);
+    int32_t bba = hash(hash(hash(xi + 1) + yi + 1) + zi);
+    int32_t bab = hash(hash(hash(xi + 1) + yi) + zi + 1);
+    int32_t bbb = hash(hash(hash(xi + 1) + yi + 1) + zi + 1);
+
+    int32_t x1 = lerp(gradient(aaa, xf, yf, zf), gradient(baa, xf - one, yf, zf), u);
+    int32_t x2 = lerp(gradient(aba, xf, yf - one, zf), gradient(bba, xf - one, yf - one, zf), u);
+    int32_t y1 = lerp(x1, x2, v);
+
+    x1 = lerp(gradient(aab, xf, yf, zf - one), gradient(bab, xf - one, yf, zf - one), u);
+    x2 = lerp(gradient(abb, xf, yf - one, zf - one), gradient(bbb, xf - one, yf - one, zf - one), u);
+    int32_t y2 = lerp(x1, x2, v);
+
+    int32_t res = (lerp(y1, y2, w) + one) >> 1;
+    return static_cast<uint16_t>(res < 0 ? 0 : res > 0xffff ? 0xffff : res);
+}
+
+std::array<uint8_t, 3> effects::hsv(uint16_t hue, uint8_t saturation, uint8_t value) {
+    uint32_t sextant = (hue >> 8) % 6;
+    uint32_t f = hue & 255;
+    uint8_t p = static_cast<uint8_t>(value * (255u - saturation) / 255u);
+    uint8_t q = static_cast<uint8_t>(value * (65280u - saturation * f) / 65280u);
+    uint8_t t = static_cast<uint8_t>(value * (65280u - saturation * (256u - f)) / 65280u);
+    switch (sextant) {
+        case 0: return { value, t, p };
+        case 1: return { q, value, p };
+        case 2: return { p, value, t };
+        case 3: return { p, q, value };
+        case 4: return { t, p, value };
+        default: return { value, p, q };
+    }
+}
+
+uint8_t effects::gamma(uint8_t x) {
+    return gamma8[x];
+}
+
+void effects::render(const Params& params, uint32_t timeMs, const size_t* ledCounts, size_t stripCount, uint8_t* grb) {
+    const Frame current = frame(params, timeMs);
+    for (size_t strip = 0; strip < stripCount; strip++) {
+        for (uint32_t led = 0; led < ledCounts[strip]; led++) {
+            auto rgb = color(params, current, led);
+            *grb++ = rgb[1];
+            *grb++ = rgb[0];
+            *grb++ = rgb[2];
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// effects rendered on the device so the host only has to send a handful of parameters instead of every frame.
+// all fixed point since the pico has no fpu, and nothing pico specific so it builds on the host too (see host/)
+namespace effects {
+    enum class Effect : uint8_t {
+        // back to whatever the host sends
+        None,
+        // perlin noise between from and to
+        Noise,
+        // CgsLedService's FireMode, scale 0.25 and speed 0.8 with 60 degrees of hue looks the same
+        Fire,
+        // from to to across scale leds and back
+        Gradient,
+        // size leds of from every scale leds, to in between
+        Chase,
+        // the mic's spectrum, drawn by spectrum::render instead
+        Spectrum
+    };
+
+    // what follows the effect's message type, multi byte values are little endian
+    struct Params {
+        Effect effect = Effect::None;
+        // 8.8, per second. noise and fire move through time, gradient and chase through leds
+        uint16_t speed = 0;
+        // 8.8, noise and fire per led, gradient and chase in leds
+        uint16_t scale = 0;
+        // fire's hue range where 1536 is all the way around, chase's lit leds
+        uint16_t size = 0;
+        // rgb
+        std::array<uint8_t, 3> from { };
+        std::array<uint8_t, 3> to { };
+    };
+    constexpr size_t paramsSize = 1 + 2 + 2 + 2 + 3 + 3;
+
+    Params parse(const uint8_t* data);
+
+    // 16.16 in, 0 to 65535 out. Perlin.cs in CgsLedService in fixed point, coordinates can't be negative
+    uint16_t perlin(int32_t x, int32_t y, int32_t z);
+
+    // hue 0 to 1535, 256 per sextant
+    std::array<uint8_t, 3> hsv(uint16_t hue, uint8_t saturation, uint8_t value);
+
+    // the same gamma the service applies
+    uint8_t gamma(uint8_t x);
+
+    // writes grb for every strip one after the other, each strip starting back at its first led like the service does
+    void render(const Params& params, uint32_t timeMs, const size_t* ledCounts, size_t stripCount, uint8_t* grb);
+}
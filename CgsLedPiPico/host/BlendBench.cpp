@@ -0,0 +1,99 @@
+#include "blend.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// checks every pair of bytes at every weight against a float crossfade and times a whole frame of it, the pico has
+// to do one of these for every frame it puts in between the host's
+
+namespace reference {
+    double mix(uint8_t from, uint8_t to, double weight, bool linearLight) {
+        if (!linearLight)
+            return from + (to - from) * weight;
+        double a = std::pow(from / 255.0, 2.2);
+        double b = std::pow(to / 255.0, 2.2);
+        return std::pow(a + (b - a) * weight, 1.0 / 2.2) * 255.0;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned int frames = argc > 1 ? static_cast<unsigned int>(strtoul(argv[1], nullptr, 10)) : 20000;
+    if (frames == 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 2;
+    }
+
+    int failures = 0;
+    for (bool linearLight : { false, true }) {
+        double maxError = 0.0;
+        double sumError = 0.0;
+        size_t count = 0;
+        size_t notMonotonic = 0;
+        size_t endpoints = 0;
+        for (int from = 0; from < 256; from++) {
+            for (int to = 0; to < 256; to++) {
+                const uint8_t a = static_cast<uint8_t>(from);
+                const uint8_t b = static_cast<uint8_t>(to);
+                int last = from;
+                for (uint16_t weight = 0; weight <= 256; weight++) {
+                    uint8_t out;
+                    blend::mix(&a, &b, &out, 1, weight, linearLight);
+                    double error = std::fabs(reference::mix(a, b, weight / 256.0, linearLight) - out);
+                    maxError = std::max(maxError, error);
+                    sumError += error;
+                    count++;
+                    if ((to >= from && out < last) || (to < from && out > last))
+                        notMonotonic++;
+                    last = out;
+                    if ((weight == 0 && out != from) || (weight == 256 && out != to))
+                        endpoints++;
+                }
+            }
+        }
+        printf("%-13s error max %.3f mean %.4f (of 255), %zu out of order, %zu wrong ends\n",
+            linearLight ? "linear light" : "bytes", maxError, sumError / count, notMonotonic, endpoints);
+        // a step the wrong way or a fade that doesn't end on the frame would show, everything else is rounding
+        if (notMonotonic > 0 || endpoints > 0 || maxError > 1.0)
+            failures++;
+    }
+
+    int shapeErrors = 0;
+    for (uint16_t progress = 0; progress <= 256; progress++) {
+        double p = progress / 256.0;
+        double expected = p * p * (3.0 - 2.0 * p) * 256.0;
+        if (std::fabs(expected - blend::shape(blend::Curve::Eased, progress)) > 1.0 || blend::shape(blend::Curve::Linear, progress) != progress)
+            shapeErrors++;
+    }
+    printf("%-13s %d off by more than a step\n", "curves", shapeErrors);
+    if (shapeErrors > 0)
+        failures++;
+
+    // the pico's strips, two random frames like a busy animation, so linear light mostly misses its shortcut
+    const size_t size = (177 + 82 + 30) * 3;
+    std::vector<uint8_t> from(size);
+    std::vector<uint8_t> to(size);
+    std::vector<uint8_t> out(size);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        from[i] = static_cast<uint8_t>(seed >> 24);
+        seed = seed * 1664525u + 1013904223u;
+        to[i] = static_cast<uint8_t>(seed >> 24);
+    }
+    unsigned int checksum = 0;
+    for (bool linearLight : { false, true }) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++) {
+            uint16_t weight = blend::shape(blend::Curve::Eased, static_cast<uint16_t>(frame % 257));
+            blend::mix(from.data(), to.data(), out.data(), size, weight, linearLight);
+            checksum += out[frame % size];
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+        printf("%-13s %.2f us/frame\n", linearLight ? "linear light" : "bytes", us);
+    }
+    // keeps the mixes from being optimized out
+    return failures > 0 || checksum == 0xffffffffu ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+#include "effects.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// times every effect over the pico's strips and checks the fixed point noise and fire against the service's float
+// versions, fails once they're further off than rounding
+
+namespace reference {
+    // Perlin.cs as is
+    int p(int i) {
+        static const int permutation[256] = {
+            151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37,
+            240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177,
+            33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166, 77, 146,
+            158, 231, 83, 111, 229, 122, 60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25,
+            63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100,
+            109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207, 206,
+            59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153,
+            101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246,
+            97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107, 49, 192,
+            214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114,
+            67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
+        };
+        return permutation[i % 256];
+    }
+
+    float fade(float t) {
+        return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+    }
+
+    float lerp(float a, float b, float t) {
+        return a + (b - a) * t;
+    }
+
+    float gradient(int hash, float x, float y, float z) {
+        int h = hash & 0b1111;
+        float u = h < 0b1000 ? x : y;
+        float v = h < 0b0100 ? y : h == 0b1100 || h == 0b1110 ? x : z;
+        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+    }
+
+    float perlin(float x, float y, float z) {
+        int xi = static_cast<int>(x) & 255;
+        int yi = static_cast<int>(y) & 255;
+        int zi = static_cast<int>(z) & 255;
+        float xf = x - static_cast<int>(x);
+        float yf = y - static_cast<int>(y);
+        float zf = z - static_cast<int>(z);
+        float u = fade(xf);
+        float v = fade(yf);
+        float w = fade(zf);
+
+        int aaa = p(p(p(xi) + yi) + zi);
+        int aba = p(p(p(xi) + yi + 1) + zi);
+        int aab = p(p(p(xi) + yi) + zi + 1);
+        int abb = p(p(p(xi) + yi + 1) + zi + 1);
+        int baa = p(p(p(xi + 1) + yi) + zi);
+        int bba = p(p(p(xi + 1) + yi + 1) + zi);
+        int bab = p(p(p(xi + 1) + yi) + zi + 1);
+        int bbb = p(p(p(xi + 1) + yi + 1) + zi + 1);
+
+        float x1 = lerp(gradient(aaa, xf, yf, zf), gradient(baa, xf - 1.f, yf, zf), u);
+        float x2 = lerp(gradient(aba, xf, yf - 1.f, zf), gradient(bba, xf - 1.f, yf - 1.f, zf), u);
+        float y1 = lerp(x1, x2, v);
+
+        x1 = lerp(gradient(aab, xf, yf, zf - 1.f), gradient(bab, xf - 1.f, yf, zf - 1.f), u);
+        x2 = lerp(gradient(abb, xf, yf - 1.f, zf - 1.f), gradient(bbb, xf - 1.f, yf - 1.f, zf - 1.f), u);
+        float y2 = lerp(x1, x2, v);
+
+        return (lerp(y1, y2, w) + 1.f) / 2.f;
+    }
+
+    // LedBuffer.WriteHsv, rgb
+    void hsv(float h, float s, float v, uint8_t* rgb) {
+        while (h >= 360.f)
+            h -= 360.f;
+        h /= 60.f;
+        int i = static_cast<int>(h);
+        float ff = h - i;
+        float p = v * (1.f - s);
+        float q = v * (1.f - (s * ff));
+        float t = v * (1.f - (s * (1.f - ff)));
+        float r, g, b;
+        switch (i) {
+            case 0: r = v; g = t; b = p; break;
+            case 1: r = q; g = v; b = p; break;
+            case 2: r = p; g = v; b = t; break;
+            case 3: r = p; g = q; b = v; break;
+            case 4: r = t; g = p; b = v; break;
+            default: r = v; g = p; b = q; break;
+        }
+        rgb[0] = effects::gamma(static_cast<uint8_t>(r * 255.f));
+        rgb[1] = effects::gamma(static_cast<uint8_t>(g * 255.f));
+        rgb[2] = effects::gamma(static_cast<uint8_t>(b * 255.f));
+    }
+
+    // FireMode.Draw, the speed and scale are 0.8 and 0.25 there
+    void fire(float seconds, float speed, float scale, size_t led, uint8_t* rgb) {
+        float t = seconds * speed;
+        float value = perlin(led * scale, 0.f, t);
+        float hue = perlin(led * scale * 0.4f, t * 0.5f, 0.f);
+        hsv(hue * 60.f, 1.f, value, rgb);
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned int frames = argc > 1 ? static_cast<unsigned int>(strtoul(argv[1], nullptr, 10)) : 10000;
+    if (frames == 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 2;
+    }
+
+    // the noise itself, in 8 bit steps since that's all that makes it to the leds
+    double noiseMax = 0.0;
+    double noiseSum = 0.0;
+    const int samples = 200000;
+    uint32_t seed = 1;
+    for (int i = 0; i < samples; i++) {
+        int32_t c[3];
+        for (auto& x : c) {
+            seed = seed * 1664525u + 1013904223u;
+            x = static_cast<int32_t>(seed >> 8) & ((256 << 16) - 1);
+        }
+        float expected = reference::perlin(c[0] / 65536.f, c[1] / 65536.f, c[2] / 65536.f) * 255.f;
+        float actual = effects::perlin(c[0], c[1], c[2]) / 65535.f * 255.f;
+        double error = std::fabs(expected - actual);
+        noiseMax = std::max(noiseMax, error);
+        noiseSum += error;
+    }
+    printf("perlin error   max %.3f mean %.4f (of 255)\n", noiseMax, noiseSum / samples);
+    int failures = 0;
+    // less than a step off on the leds
+    if (noiseMax > 1.0)
+        failures++;
+
+    const size_t ledCounts[] = { 177, 82, 30 };
+    const size_t stripCount = sizeof(ledCounts) / sizeof(ledCounts[0]);
+    size_t totalLeds = 0;
+    for (size_t count : ledCounts)
+        totalLeds += count;
+    std::vector<uint8_t> grb(totalLeds * 3);
+
+    // FireMode's parameters against FireMode itself, as close as 8.8 gets to them
+    effects::Params fire;
+    fire.effect = effects::Effect::Fire;
+    fire.speed = static_cast<uint16_t>(0.8 * 256);
+    fire.scale = static_cast<uint16_t>(0.25 * 256);
+    fire.size = 256;
+    int fireMax = 0;
+    double fireSum = 0.0;
+    size_t fireCount = 0;
+    for (uint32_t ms = 0; ms < 60000; ms += 37) {
+        effects::render(fire, ms, ledCounts, stripCount, grb.data());
+        const uint8_t* actual = grb.data();
+        for (size_t strip = 0; strip < stripCount; strip++) {
+            for (size_t led = 0; led < ledCounts[strip]; led++) {
+                uint8_t rgb[3];
+                reference::fire(ms / 1000.f, fire.speed / 256.f, fire.scale / 256.f, led, rgb);
+                const uint8_t expected[3] = { rgb[1], rgb[0], rgb[2] };
+                for (int i = 0; i < 3; i++) {
+                    int error = std::abs(expected[i] - actual[i]);
+                    fireMax = std::max(fireMax, error);
+                    fireSum += error;
+                    fireCount++;
+                }
+                actual += 3;
+            }
+        }
+    }
+    printf("fire error     max %d mean %.4f (of 255)\n", fireMax, fireSum / fireCount);
+    // the speed and scale are as close as 8.8 gets, and the hsv truncates where the float one rounds
+    if (fireMax > 3 || fireSum / fireCount > 0.5)
+        failures++;
+
+    effects::Params params[4];
+    params[0] = fire;
+    params[1].effect = effects::Effect::Noise;
+    params[1].speed = 256;
+    params[1].scale = 64;
+    params[1].from = { 0, 0, 0 };
+    params[1].to = { 255, 80, 0 };
+    params[2].effect = effects::Effect::Gradient;
+    params[2].speed = 20 * 256;
+    params[2].scale = 60 * 256;
+    params[2].from = { 255, 0, 0 };
+    params[2].to = { 0, 0, 255 };
+    params[3].effect = effects::Effect::Chase;
+    params[3].speed = 30 * 256;
+    params[3].scale = 32 * 256;
+    params[3].size = 4;
+    params[3].from = { 0, 128, 255 };
+    const char* names[4] = { "fire", "noise", "gradient", "chase" };
+    unsigned int checksum = 0;
+    for (int i = 0; i < 4; i++) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++) {
+            effects::render(params[i], frame * 5, ledCounts, stripCount, grb.data());
+            checksum += grb[frame % grb.size()];
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+        printf("%-14s %.2f us/frame\n", names[i], us);
+    }
+    // keeps the renders from being optimized out
+    return failures > 0 || checksum == 0xffffffffu ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#include "planar.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// the planar encode against pulling every bit out of the frame one at a time, for random frames over random
+// layouts with uneven and empty lanes. fails on the first thing that's off
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok)
+        return;
+    printf("failed: %s\n", what);
+    failures++;
+}
+
+static uint32_t seed = 1;
+static uint32_t next() {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+// the byte the state machine shifts out for bit time t, it takes each word low byte first
+static uint8_t bitTime(const uint32_t* out, size_t t) {
+    return static_cast<uint8_t>(out[t / 4] >> (t % 4 * 8));
+}
+
+// how many bit times the encode got wrong against going bit by bit
+static size_t compare(const uint8_t* data, const std::array<planar::Lane, planar::maxLanes>& lanes, size_t longest) {
+    std::vector<uint32_t> out(planar::wordsFor(longest) + 1, 0xdeadbeef);
+    planar::encode(data, lanes, longest, out.data());
+    size_t wrong = out.back() != 0xdeadbeef;
+    for (size_t i = 0; i < longest; i++) {
+        for (size_t bit = 0; bit < 8; bit++) {
+            uint8_t expected = 0;
+            for (size_t lane = 0; lane < planar::maxLanes; lane++) {
+                if (i < lanes[lane].size && (data[lanes[lane].offset + i] >> (7 - bit)) & 1)
+                    expected |= 1 << lane;
+            }
+            wrong += bitTime(out.data(), i * 8 + bit) != expected;
+        }
+    }
+    return wrong;
+}
+
+int main(int argc, char** argv) {
+    const size_t frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000;
+    if (frames == 0) {
+        fprintf(stderr, "usage: %s [random frames]\n", argv[0]);
+        return 2;
+    }
+
+    {
+        // every single bit on its own has to land on its lane and bit time and nowhere else
+        bool ok = true;
+        for (size_t lane = 0; lane < planar::maxLanes; lane++) {
+            for (size_t bit = 0; bit < 8; bit++) {
+                uint8_t rows[planar::maxLanes] = { };
+                rows[planar::maxLanes - 1 - lane] = static_cast<uint8_t>(0x80 >> bit);
+                uint32_t out[2];
+                planar::transpose(rows, out);
+                for (size_t t = 0; t < 8; t++)
+                    ok = ok && bitTime(out, t) == (t == bit ? 1 << lane : 0);
+            }
+        }
+        check(ok, "single bits");
+    }
+
+    {
+        // the layout the strips had when planar went in, with the pins in between that have none
+        const size_t sizes[planar::maxLanes] = { 531, 0, 246, 90, 3, 531, 60, 12 };
+        std::array<planar::Lane, planar::maxLanes> lanes;
+        size_t total = 0;
+        size_t longest = 0;
+        for (size_t lane = 0; lane < planar::maxLanes; lane++) {
+            lanes[lane] = { total, sizes[lane] };
+            total += sizes[lane];
+            longest = std::max(longest, sizes[lane]);
+        }
+        std::vector<uint8_t> data(total);
+        for (auto& x : data)
+            x = static_cast<uint8_t>(next());
+        check(compare(data.data(), lanes, longest) == 0, "fixed layout");
+    }
+
+    size_t wrong = 0;
+    size_t bitTimes = 0;
+    for (size_t frame = 0; frame < frames; frame++) {
+        // lanes in any order through the frame, some empty and some just a byte or two
+        std::array<planar::Lane, planar::maxLanes> lanes;
+        size_t total = 0;
+        size_t longest = 0;
+        for (auto& lane : lanes) {
+            uint32_t kind = next() % 4;
+            lane.size = kind == 0 ? 0 : kind == 1 ? 1 + next() % 3 : next() % 200;
+            longest = std::max(longest, lane.size);
+        }
+        size_t order[planar::maxLanes] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+        for (size_t i = planar::maxLanes - 1; i > 0; i--)
+            std::swap(order[i], order[next() % (i + 1)]);
+        for (size_t i : order) {
+            lanes[i].offset = total;
+            total += lanes[i].size;
+        }
+        std::vector<uint8_t> data(total);
+        for (auto& x : data)
+            x = static_cast<uint8_t>(next());
+        wrong += compare(data.data(), lanes, longest);
+        bitTimes += longest * 8;
+    }
+    printf("%zu random frames, %zu bit times, %zu wrong\n", frames, bitTimes, wrong);
+    check(wrong == 0, "random frames");
+
+    printf("%s\n", failures == 0 ? "all good" : "failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include "ring.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <thread>
+
+// what the audio ring costs per block against the std::queue<uint8_t> it replaced, then how fast it goes with the
+// producer and the consumer on different threads. fails if anything comes out different from what went in
+
+namespace {
+    constexpr size_t blockSize = 1024;
+    // same as audio.cpp, four of its buffers
+    constexpr size_t ringSize = 4096;
+
+    template<typename Write, typename Read>
+    double nsPerBlock(unsigned int blocks, Write write, Read read, uint32_t& checksum) {
+        uint8_t in[blockSize];
+        uint8_t out[blockSize];
+        for (size_t i = 0; i < blockSize; i++)
+            in[i] = static_cast<uint8_t>(i * 7);
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int block = 0; block < blocks; block++) {
+            in[block % blockSize]++;
+            write(in);
+            read(out);
+            checksum += out[block % blockSize];
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / blocks;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned int blocks = argc > 1 ? static_cast<unsigned int>(strtoul(argv[1], nullptr, 10)) : 200000;
+    if (blocks == 0) {
+        fprintf(stderr, "usage: %s [blocks]\n", argv[0]);
+        return 2;
+    }
+
+    uint32_t ringChecksum = 0;
+    static Ring<ringSize> ring;
+    double ringNs = nsPerBlock(blocks,
+        [&](const uint8_t* in) { ring.write(in, blockSize); },
+        [&](uint8_t* out) { ring.read(out, blockSize); },
+        ringChecksum);
+
+    uint32_t queueChecksum = 0;
+    std::queue<uint8_t> queue;
+    double queueNs = nsPerBlock(blocks,
+        [&](const uint8_t* in) {
+            for (size_t i = 0; i < blockSize; i++)
+                queue.push(in[i]);
+        },
+        [&](uint8_t* out) {
+            for (size_t i = 0; i < blockSize; i++) {
+                out[i] = queue.front();
+                queue.pop();
+            }
+        },
+        queueChecksum);
+    printf("ring           %.0f ns per %zu byte block\n", ringNs, blockSize);
+    printf("std::queue     %.0f ns per %zu byte block\n", queueNs, blockSize);
+
+    // a block at a time from another thread, like the usb core filling it and the speaker irq draining it
+    const size_t total = static_cast<size_t>(blocks) * blockSize;
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&] {
+        uint8_t in[blockSize];
+        for (size_t sent = 0; sent < total;) {
+            for (size_t i = 0; i < blockSize; i++)
+                in[i] = static_cast<uint8_t>(sent + i);
+            for (size_t written = 0; written < blockSize;) {
+                size_t count = ring.write(in + written, blockSize - written);
+                // full, and there might not be another core to empty it
+                if (count == 0)
+                    std::this_thread::sleep_for(std::chrono::microseconds(20));
+                written += count;
+            }
+            sent += blockSize;
+        }
+    });
+    size_t wrong = 0;
+    uint8_t out[blockSize];
+    for (size_t received = 0; received < total;) {
+        size_t count = ring.read(out, blockSize);
+        if (count == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        for (size_t i = 0; i < count; i++)
+            wrong += out[i] != static_cast<uint8_t>(received + i);
+        received += count;
+    }
+    producer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("two threads    %.0f MB/s, %zu bytes wrong\n", total / seconds / 1e6, wrong);
+
+    return wrong > 0 || ringChecksum != queueChecksum ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+#include "ring.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+// the audio ring's edge cases on one thread, then a pattern pushed through it from another thread in odd sized
+// chunks like the usb core and the speaker irq do. fails on the first thing that's off
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok)
+        return;
+    printf("failed: %s\n", what);
+    failures++;
+}
+
+int main(int argc, char** argv) {
+    const size_t megabytes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 16;
+    if (megabytes == 0) {
+        fprintf(stderr, "usage: %s [megabytes through two threads]\n", argv[0]);
+        return 2;
+    }
+
+    {
+        Ring<8> ring;
+        uint8_t in[16];
+        uint8_t out[16] = { };
+        for (uint8_t i = 0; i < 16; i++)
+            in[i] = static_cast<uint8_t>(i + 1);
+        check(ring.size() == 0 && ring.read(out, 4) == 0, "empty reads nothing");
+        check(ring.write(in, 16) == 8 && ring.size() == 8, "full takes only what fits");
+        check(ring.write(in, 1) == 0, "full takes nothing more");
+        check(ring.read(out, 3) == 3 && out[0] == 1 && out[2] == 3 && ring.size() == 5, "partial read");
+        check(ring.read(out, 16) == 5 && out[0] == 4 && out[4] == 8 && ring.size() == 0, "reads only what's there");
+        // both sides 3 into their second turn, then 5 fit before the end and the other 2 go around to the start
+        check(ring.write(in, 3) == 3 && ring.read(out, 3) == 3, "both sides move on");
+        check(ring.write(in + 8, 7) == 7 && ring.size() == 7, "write wraps around");
+        check(ring.read(out, 16) == 7, "read wraps around");
+        bool order = true;
+        for (size_t i = 0; i < 7; i++)
+            order = order && out[i] == in[8 + i];
+        check(order, "bytes come out in order across the wrap");
+        check(ring.write(in, 5) == 5 && ring.size() == 5, "write after wrap");
+        ring.clear();
+        check(ring.size() == 0 && ring.read(out, 1) == 0, "clear drops everything");
+        check(ring.write(in, 8) == 8 && ring.size() == 8, "full again after clear");
+    }
+
+    {
+        // the counters only ever count up, lots of turns around a small ring
+        Ring<4> ring;
+        bool ok = true;
+        uint8_t next = 0;
+        uint8_t expected = 0;
+        for (size_t turn = 0; turn < 100000 && ok; turn++) {
+            uint8_t chunk[3];
+            for (auto& x : chunk)
+                x = next++;
+            size_t written = ring.write(chunk, 1 + turn % 3);
+            next = static_cast<uint8_t>(next - (3 - written));
+            uint8_t out[4];
+            size_t read = ring.read(out, 1 + turn % 2);
+            for (size_t i = 0; i < read; i++)
+                ok = ok && out[i] == expected++;
+        }
+        check(ok, "many turns around a small ring");
+    }
+
+    {
+        Ring<1024> ring;
+        const size_t total = megabytes << 20;
+        std::thread producer([&] {
+            uint8_t chunk[97];
+            size_t sent = 0;
+            uint32_t seed = 1;
+            while (sent < total) {
+                seed = seed * 1664525u + 1013904223u;
+                size_t count = std::min<size_t>(1 + (seed >> 24) % sizeof(chunk), total - sent);
+                for (size_t i = 0; i < count; i++)
+                    chunk[i] = static_cast<uint8_t>((sent + i) * 7);
+                size_t written = 0;
+                while (written < count) {
+                    written += ring.write(chunk + written, count - written);
+                    if (written < count)
+                        std::this_thread::sleep_for(std::chrono::microseconds(20));
+                }
+                sent += count;
+            }
+        });
+        size_t received = 0;
+        size_t wrong = 0;
+        uint8_t chunk[61];
+        while (received < total) {
+            size_t count = ring.read(chunk, sizeof(chunk));
+            if (count == 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            for (size_t i = 0; i < count; i++)
+                wrong += chunk[i] != static_cast<uint8_t>((received + i) * 7);
+            received += count;
+        }
+        producer.join();
+        printf("%zu MB through two threads, %zu bytes wrong\n", megabytes, wrong);
+        check(wrong == 0 && ring.size() == 0, "two threads");
+    }
+
+    printf("%s\n", failures == 0 ? "all good" : "failed");
+    return failures == 0 ? 0 : 1;
+}
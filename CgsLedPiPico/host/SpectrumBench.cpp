@@ -0,0 +1,205 @@
+#include "spectrum.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// checks the fixed point fft against a plain dft and the levels against FftEffect in floats, times a block, and
+// with a wav file shows what the strips would do with it over time. the wav gets mixed down and resampled to
+// spectrum::sampleRate like the adc would see it. fails if the fft or the levels are further off than rounding
+
+#if defined(__x86_64__) || defined(__i386__)
+static const char* const cycleUnit = "cycles";
+static double cycles() {
+    return static_cast<double>(__rdtsc());
+}
+#else
+static const char* const cycleUnit = "ns";
+static double cycles() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// FftEffect.GetBin and ProcessBin with the bins in 1.15, then the same 0 to 255 as spectrum::level
+static int referenceLevel(const uint16_t* bins, size_t count, double position, double noiseCut) {
+    const double p = position;
+    const double along = std::max({ p * p, (p - 0.4) * 1.4 + 0.16, p / 4.0 });
+    const double at = along * static_cast<double>(count - 1);
+    const size_t index = static_cast<size_t>(at);
+    const double frac = at - static_cast<double>(index);
+    const double current = bins[index];
+    const double next = index + 1 < count ? bins[index + 1] : current;
+    const double bin = (current + (next - current) * frac * frac * (3.0 - 2.0 * frac)) / 32768.0;
+    const double x = std::sqrt(std::min(bin / 0.6496, 1.0));
+    const double res = std::max(x / 5.0, (x - noiseCut) / (1.0 - noiseCut));
+    return std::clamp(static_cast<int>(res * 256.0), 0, 255);
+}
+
+// 16 bit pcm only, which is what anything records by default
+static bool readWav(const char* path, std::vector<int16_t>& samples, uint32_t& rate) {
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    fclose(file);
+    auto u16 = [&](size_t at) { return static_cast<uint32_t>(bytes[at] | (bytes[at + 1] << 8)); };
+    auto u32 = [&](size_t at) { return u16(at) | (u16(at + 2) << 16); };
+    if (bytes.size() < 12 || memcmp(bytes.data(), "RIFF", 4) != 0 || memcmp(&bytes[8], "WAVE", 4) != 0)
+        return false;
+    uint32_t format = 0;
+    uint32_t channels = 0;
+    uint32_t bits = 0;
+    for (size_t at = 12; at + 8 <= bytes.size();) {
+        const uint32_t size = u32(at + 4);
+        const size_t body = at + 8;
+        if (body + size > bytes.size())
+            return false;
+        if (memcmp(&bytes[at], "fmt ", 4) == 0 && size >= 16) {
+            format = u16(body);
+            channels = u16(body + 2);
+            rate = u32(body + 4);
+            bits = u16(body + 14);
+        }
+        else if (memcmp(&bytes[at], "data", 4) == 0) {
+            if (format != 1 || bits != 16 || channels == 0)
+                return false;
+            for (size_t i = body; i + channels * 2 <= body + size; i += channels * 2) {
+                int32_t sum = 0;
+                for (uint32_t c = 0; c < channels; c++)
+                    sum += static_cast<int16_t>(u16(i + c * 2));
+                samples.push_back(static_cast<int16_t>(sum / static_cast<int32_t>(channels)));
+            }
+            return true;
+        }
+        at = body + size + (size & 1);
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [recording.wav]\n", argv[0]);
+        return 2;
+    }
+
+    // random full scale input against a double precision dft, in 1.15 steps
+    std::array<spectrum::Complex, spectrum::fftSize> x;
+    std::vector<double> input(spectrum::fftSize);
+    uint32_t seed = 1;
+    double maxError = 0.0;
+    for (int round = 0; round < 50; round++) {
+        for (size_t i = 0; i < spectrum::fftSize; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            int16_t sample = static_cast<int16_t>(seed >> 16);
+            input[i] = sample;
+            x[i] = { sample, 0 };
+        }
+        spectrum::fft(x);
+        for (size_t k = 0; k < spectrum::fftSize; k++) {
+            double re = 0.0;
+            double im = 0.0;
+            for (size_t n = 0; n < spectrum::fftSize; n++) {
+                double angle = -2.0 * 3.14159265358979323846 * static_cast<double>(k * n % spectrum::fftSize) / spectrum::fftSize;
+                re += input[n] * std::cos(angle);
+                im += input[n] * std::sin(angle);
+            }
+            re /= spectrum::fftSize;
+            im /= spectrum::fftSize;
+            maxError = std::max(maxError, std::max(std::fabs(re - x[k].re), std::fabs(im - x[k].im)));
+        }
+    }
+    printf("fft error      max %.2f (of 32768)\n", maxError);
+    int failures = 0;
+    // every butterfly rounds down, a few steps over all 4 stages
+    if (maxError > 8.0)
+        failures++;
+
+    // random bins up to the loudest a windowed full scale block gets, along the strip in the service's 56 bins
+    // and all of them, with no noise cut and the service's 0.25
+    int levelMax = 0;
+    size_t levelOff = 0;
+    size_t levelCount = 0;
+    std::array<uint16_t, spectrum::binCount> bins;
+    for (int round = 0; round < 200; round++) {
+        for (auto& bin : bins) {
+            seed = seed * 1664525u + 1013904223u;
+            bin = static_cast<uint16_t>((seed >> 16) % (round % 2 == 0 ? 4096 : 32768));
+        }
+        for (size_t count : { size_t(1), size_t(56), spectrum::binCount }) {
+            for (uint16_t noiseCut : { 0, 16384 }) {
+                for (uint32_t position = 0; position < 65536; position += 61) {
+                    int error = std::abs(spectrum::level(bins.data(), count, static_cast<uint16_t>(position), noiseCut) -
+                        referenceLevel(bins.data(), count, position / 65536.0, noiseCut / 65536.0));
+                    levelMax = std::max(levelMax, error);
+                    levelOff += error > 1;
+                    levelCount++;
+                }
+            }
+        }
+    }
+    printf("level error    max %d, %zu of %zu off by more than a step\n", levelMax, levelOff, levelCount);
+    // the fixed point square roots round down, with the noise cut's 1.33 gain that can add up to 2 steps
+    if (levelMax > 2)
+        failures++;
+
+    std::vector<int16_t> samples;
+    uint32_t rate = spectrum::sampleRate;
+    if (argc == 2) {
+        std::vector<int16_t> recorded;
+        if (!readWav(argv[1], recorded, rate)) {
+            fprintf(stderr, "couldn't read %s as 16 bit pcm\n", argv[1]);
+            return 1;
+        }
+        for (double at = 0.0; at + 1.0 < recorded.size(); at += static_cast<double>(rate) / spectrum::sampleRate) {
+            size_t i = static_cast<size_t>(at);
+            double frac = at - static_cast<double>(i);
+            samples.push_back(static_cast<int16_t>(recorded[i] + (recorded[i + 1] - recorded[i]) * frac));
+        }
+    }
+    else {
+        // a sweep through the bins the strips show
+        for (size_t i = 0; i < spectrum::sampleRate * 5; i++) {
+            double t = static_cast<double>(i) / spectrum::sampleRate;
+            double frequency = 50.0 + 2500.0 * t / 5.0;
+            samples.push_back(static_cast<int16_t>(std::sin(2.0 * 3.14159265358979323846 * frequency * t) * 16000.0));
+        }
+    }
+
+    spectrum::Analyzer analyzer;
+    const size_t blocks = samples.size() / spectrum::fftSize;
+    double processCycles = 0.0;
+    double levelCycles = 0.0;
+    // one line of 32 leds every 100ms or so, one side of a mirrored strip
+    const char* shades = " .:-=+*#%@";
+    const size_t every = std::max<size_t>(spectrum::sampleRate / 10 / spectrum::fftSize, 1);
+    for (size_t block = 0; block < blocks; block++) {
+        double start = cycles();
+        analyzer.process(&samples[block * spectrum::fftSize]);
+        double processed = cycles();
+        uint8_t levels[32];
+        for (size_t i = 0; i < 32; i++)
+            levels[i] = spectrum::level(analyzer.bins().data(), 56, static_cast<uint16_t>(i * 65536 / 32), 16384);
+        levelCycles += cycles() - processed;
+        processCycles += processed - start;
+        if (block % every == 0) {
+            char line[33];
+            for (size_t i = 0; i < 32; i++)
+                line[i] = shades[levels[i] * 10 / 256];
+            line[32] = 0;
+            printf("%7.2fs |%s|\n", static_cast<double>(block * spectrum::fftSize) / spectrum::sampleRate, line);
+        }
+    }
+    if (blocks > 0)
+        printf("%zu blocks, %.0f %s/block, %.0f %s per 32 levels\n", blocks, processCycles / blocks, cycleUnit,
+            levelCycles / blocks, cycleUnit);
+    return failures > 0 ? 1 : 0;
+}
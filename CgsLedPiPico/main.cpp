@@ -1,105 +1,351 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <array>
 
 #include "pico/stdlib.h"
 #include "pico/bootrom.h"
-#include "pico/stdio/driver.h"
+#include "pico/multicore.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
 #include "hardware/clocks.h"
 #include "hardware/pwm.h"
+#include "hardware/adc.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "tusb.h"
 #include "ws2812.pio.h"
 
 #include "audio/musicbox.h"
+#include "adpcm.hpp"
 #include "audio.hpp"
-
-#define STB_VORBIS_MAX_CHANNELS 1
-#include "stb_vorbis.c"
+#include "effects.hpp"
+#include "spectrum.hpp"
+#include "blend.hpp"
+#include "planar.hpp"
+#include "protocol.hpp"
 
 // --- SETTINGS ---
 
 struct led_data {
     uint8_t m_pin;
     size_t m_size;
-    PIO m_pio;
-    uint32_t m_sm;
-    uint32_t m_dma;
-
-    led_data(uint8_t pin, size_t count, PIO ppio, uint32_t sm) :
-        m_pin(pin), m_size(count * 3), m_pio(ppio), m_sm(sm) { }
 
-    void put(uint32_t x) const {
-        pio_sm_put_blocking(m_pio, m_sm, x);
-    }
+    constexpr led_data(uint8_t pin, size_t count) : m_pin(pin), m_size(count * 3) { }
 };
 
+// in the order the host sends them. one state machine drives all of them, so they have to be within 8 consecutive pins
 constexpr size_t stripCount = 3;
-static std::array<led_data, stripCount> strips = {
-    led_data(11, 177, pio0, 0),
-    led_data(12, 82, pio1, 0),
-    led_data(13, 30, pio1, 1)
+constexpr std::array<led_data, stripCount> strips = {
+    led_data(11, 177),
+    led_data(12, 82),
+    led_data(13, 30)
 };
+PIO const stripsPio = pio0;
+constexpr uint32_t stripsSm = 0;
 constexpr uint8_t relayPin = 21;
+// adc 0, a mic or line in biased to about half of 3.3v
+constexpr uint8_t micPin = 26;
 bool powered = false;
 
 // ----------------
 
 constexpr size_t totalDataCount = 177 * 3 + 82 * 3 + 30 * 3;
-
-enum class DataType : uint8_t {
+constexpr std::array<size_t, stripCount> ledCounts = [] {
+    std::array<size_t, stripCount> res { };
+    for (size_t i = 0; i < stripCount; i++)
+        res[i] = strips[i].m_size / 3;
+    return res;
+}();
+
+constexpr uint8_t stripsPinBase = std::min_element(strips.begin(), strips.end(),
+    [](const led_data& a, const led_data& b) { return a.m_pin < b.m_pin; })->m_pin;
+constexpr uint8_t stripsPinCount = std::max_element(strips.begin(), strips.end(),
+    [](const led_data& a, const led_data& b) { return a.m_pin < b.m_pin; })->m_pin - stripsPinBase + 1;
+static_assert(stripsPinCount <= planar::maxLanes, "strips have to be within 8 consecutive pins");
+constexpr std::array<planar::Lane, planar::maxLanes> stripLanes = [] {
+    std::array<planar::Lane, planar::maxLanes> res { };
+    size_t offset = 0;
+    for (const auto& strip : strips) {
+        res[strip.m_pin - stripsPinBase] = { offset, strip.m_size };
+        offset += strip.m_size;
+    }
+    return res;
+}();
+constexpr size_t longestStrip = std::max_element(strips.begin(), strips.end(),
+    [](const led_data& a, const led_data& b) { return a.m_size < b.m_size; })->m_size;
+constexpr size_t planeWords = planar::wordsFor(longestStrip);
+uint32_t stripsDma;
+uint32_t latchAlarm;
+// ws2812b wants at least 280us low before it latches
+constexpr uint32_t latchUs = 300;
+// the dma is done once the last word is in the pio's joined fifo, 8 of those plus the one shifting out at 4 bits
+// each still have to go out before the latch even starts
+constexpr uint32_t fifoDrainUs = (8 + 1) * 4 * 1000000 / 670000 + 1;
+
+using protocol::DataType;
+using protocol::ReplyType;
+
+// core 1 takes usb in and decodes into data, which always holds the latest frame so spans have something to patch.
+// finished frames get transposed into an output and handed to core 0, which queues it for the strips. the dma
+// interrupt hands it back to core 1 as soon as it's been read, nothing ever gets written while it's going out.
+// the outputs after core 1's are core 0's own for the effect
+std::array<uint8_t, totalDataCount> data;
+std::array<uint8_t, 256 * 3> palette;
+// the on-device effect core 1 draws into data whenever an output's free, its time starts when it's set
+effects::Params deviceEffect;
+uint32_t deviceEffectStartMs = 0;
+// with interpolation on core 1 fades from whatever's showing to every new frame over about as long as frames have been
+// coming apart, so the strips always run one frame behind the host. the fades go out as often as the rate allows
+blend::Params interpolation;
+std::array<uint8_t, totalDataCount> fadeFrom;
+// the last frame that went to the strips, faded or not
+std::array<uint8_t, totalDataCount> shown;
+bool fading = false;
+absolute_time_t fadeStart;
+absolute_time_t nextFade;
+absolute_time_t lastReceived;
+uint32_t frameIntervalUs = 1000000 / 60;
+// slower than that and it's not an animation anymore, there's no point in fading that long
+constexpr uint32_t maxFadeUs = 100000;
+// two blocks back to back, the dma fills one while the other's analyzed
+uint32_t micDma;
+uint32_t micControlDma;
+std::array<uint16_t, 2 * spectrum::fftSize> micSamples;
+const uint16_t* const micStart = micSamples.data();
+uint32_t micFilling = 0;
+bool micRunning = false;
+spectrum::Analyzer analyzer;
+// the ones core 1 doesn't have are queued for the strips, going out, or held until they're due
+constexpr uint32_t outputCount = 6;
+// they all come back over core 0's side of the fifo, that's 8 deep
+static_assert(outputCount <= 8);
+constexpr uint32_t effectCount = 2;
+std::array<std::array<uint32_t, planeWords>, outputCount + effectCount> outputs;
+
+// core 1 to core 0 over the inter-core fifo, the command in the top byte and its value below.
+// core 0 only ever sends back the index of an output it's done with
+enum class CoreCommand : uint8_t {
+    // an output to show
+    Show,
+    // an output to show once it's due, the due time follows as a message of its own
+    ShowAt,
     Power,
-    Data,
-    Ping
+    // nothing from the host in a while
+    Idle
 };
 
-std::array<uint8_t, totalDataCount> data;
+uint32_t coreMessage(CoreCommand command, uint32_t value) {
+    return (static_cast<uint32_t>(command) << 24) | value;
+}
 
-// freddor
+// framed messages are checked in here before any of it reaches the strips, the handlers then read from it
+// instead of usb. after a bad one everything up to the next marker is skipped
+std::array<uint8_t, protocol::maxFrameSize(totalDataCount)> frame;
+const uint8_t* frameCursor = nullptr;
+const uint8_t* frameEnd = nullptr;
+protocol::Sequence frameSequence;
+bool hunting = false;
+absolute_time_t lastByte;
+constexpr int64_t huntingTimeoutUs = 50000;
+// a whole frame takes under a millisecond over usb. one whose length got mangled would otherwise keep eating the
+// frames behind it, or wait for bytes that never come
+constexpr int64_t frameTimeoutUs = 20000;
+
+// freddor, all of it on core 0
 bool freddy = false;
 bool freddyShown = true;
-stb_vorbis* freddyVorbis = nullptr;
+// decoded on the fly straight out of flash, see tools/musicbox.cpp
+adpcm::Decoder freddySong;
 constexpr uint8_t freddyBrightness = 63;
 constexpr uint8_t speakerPowerPin = 22;
 constexpr uint8_t speakerDataPin = 20;
-
+// core 0's own frame for freddy and powering off
+std::array<uint8_t, totalDataCount> effect;
+// which effect outputs are queued or being read, and the one the next effect goes into
+volatile bool effectBusy[effectCount] = { };
+uint32_t nextEffect = 0;
+
+// outputs waiting for the strips, the latch alarm starts the next one. there's never more queued than there are outputs.
+// only touched by core 0 and its interrupts
+constexpr uint32_t stripsQueueSize = 8;
+static_assert(stripsQueueSize >= outputCount + effectCount);
+std::array<uint32_t, stripsQueueSize> stripsQueue;
+volatile uint32_t stripsQueueHead = 0;
+volatile uint32_t stripsQueueTail = 0;
+// the output the dma is reading
+volatile uint32_t readingOutput = 0;
+// nothing going out and the latch is over
+volatile bool stripsIdle = true;
+
+// timed outputs waiting for their due time, earliest first, the due alarm hands them to the strips.
+// only touched by core 0 and its interrupts
+struct TimedOutput {
+    uint32_t output;
+    absolute_time_t due;
+};
+std::array<TimedOutput, outputCount> timedQueue;
+volatile uint32_t timedCount = 0;
+uint32_t dueAlarm;
+// further ahead than that the host's idea of our clock is off, holding it would only stall everything behind it
+constexpr int32_t maxLeadUs = 250000;
+// core 1 reports these
+volatile uint32_t lateFrames = 0;
+volatile uint32_t earlyFrames = 0;
+
+// usb is drained in here whenever we'd otherwise just wait so the host can keep frames in flight,
+// the credits we give out are how many whole frames are guaranteed to fit
+constexpr size_t rxQueueSize = 4096;
+constexpr uint8_t frameCredits = rxQueueSize / (1 + totalDataCount + 1);
+static_assert(frameCredits > 0 && frameCredits < 0x80);
+std::array<uint8_t, rxQueueSize> rxQueue;
+size_t rxHead = 0;
+size_t rxTail = 0;
+
+// replies are dropped while nobody has the port open, like stdio's cdc did. the tx fifo only holds 64 bytes so
+// tinyusb has to send some of it before the rest of a longer reply fits
+void usbWrite(const uint8_t* x, size_t size) {
+    while (size > 0 && tud_cdc_connected()) {
+        uint32_t written = tud_cdc_write(x, size);
+        x += written;
+        size -= written;
+        if (size == 0)
+            break;
+        tud_task();
+        tud_cdc_write_flush();
+    }
+    tud_cdc_write_flush();
+}
 void usbWrite(const uint8_t x) {
-    stdio_usb.out_chars(reinterpret_cast<const char*>(&x), 1);
+    usbWrite(&x, 1);
+}
+// tinyusb only gets to run in here, everything that waits on usb calls it
+void usbPoll() {
+    tud_task();
+    while (rxTail - rxHead < rxQueueSize) {
+        size_t index = rxTail % rxQueueSize;
+        size_t space = std::min(rxQueueSize - (rxTail - rxHead), rxQueueSize - index);
+        uint32_t res = tud_cdc_read(&rxQueue[index], space);
+        if (res == 0)
+            break;
+        rxTail += res;
+    }
 }
 bool usbTryRead(uint8_t& x) {
-    auto res = stdio_usb.in_chars(reinterpret_cast<char*>(&x), 1);
-    return res != PICO_ERROR_NO_DATA;
+    if (rxHead == rxTail)
+        usbPoll();
+    if (rxHead == rxTail)
+        return false;
+    x = rxQueue[rxHead++ % rxQueueSize];
+    return true;
 }
 
-void showAll() {
-    for (const auto& strip : strips) {
-        dma_channel_wait_for_finish_blocking(strip.m_dma);
-    }
-    size_t currStart = 0;
-    for (const auto& strip : strips) {
-        dma_channel_set_read_addr(strip.m_dma, &data[currStart], true);
-        currStart += strip.m_size;
+// --- core 0 ---
+
+// interrupts off or from one
+void startStrips(uint32_t output) {
+    readingOutput = output;
+    stripsIdle = false;
+    dma_channel_set_read_addr(stripsDma, outputs[output].data(), true);
+}
+
+void latchDone(uint alarm) {
+    if (stripsQueueHead != stripsQueueTail)
+        startStrips(stripsQueue[stripsQueueHead++ % stripsQueueSize]);
+    else
+        stripsIdle = true;
+}
+
+void stripsDmaDone() {
+    dma_hw->ints0 = 1u << stripsDma;
+    // everything's been read, core 1 can have it back. the fifo can't fill up, there's only ever outputCount in it
+    uint32_t output = readingOutput;
+    if (output < outputCount)
+        multicore_fifo_push_blocking(output);
+    else
+        effectBusy[output - outputCount] = false;
+    if (hardware_alarm_set_target(latchAlarm, make_timeout_time_us(fifoDrainUs + latchUs)))
+        latchDone(latchAlarm);
+}
+
+// never waits, the strips pick it up after whatever's ahead of it
+void showOutput(uint32_t output) {
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (stripsIdle)
+        startStrips(output);
+    else
+        stripsQueue[stripsQueueTail++ % stripsQueueSize] = output;
+    restore_interrupts(interrupts);
+}
+
+// interrupts off or from the alarm itself
+void armDue();
+void dueDone(uint alarm) {
+    // everything that's due by now goes out in order
+    uint32_t ready = 0;
+    while (ready < timedCount && time_reached(timedQueue[ready].due))
+        showOutput(timedQueue[ready++].output);
+    for (uint32_t i = ready; i < timedCount; i++)
+        timedQueue[i - ready] = timedQueue[i];
+    timedCount -= ready;
+    armDue();
+}
+
+void armDue() {
+    if (timedCount > 0 && hardware_alarm_set_target(dueAlarm, timedQueue[0].due))
+        dueDone(dueAlarm);
+}
+
+// holds it until it's due, the host's clock offset already took care of how long it was on its way
+void showOutputAt(uint32_t output, uint32_t dueUs) {
+    int32_t ahead = static_cast<int32_t>(dueUs - time_us_32());
+    if (ahead <= 0 || ahead > maxLeadUs) {
+        if (ahead <= 0)
+            lateFrames++;
+        else
+            earlyFrames++;
+        showOutput(output);
+        return;
     }
+    absolute_time_t due = make_timeout_time_us(ahead);
+    uint32_t interrupts = save_and_disable_interrupts();
+    // there's never more than a handful, an insertion keeps them sorted
+    uint32_t i = timedCount;
+    for (; i > 0 && absolute_time_diff_us(due, timedQueue[i - 1].due) > 0; i--)
+        timedQueue[i] = timedQueue[i - 1];
+    timedQueue[i] = { output, due };
+    timedCount++;
+    armDue();
+    restore_interrupts(interrupts);
+}
+
+void showAll() {
+    // both effect outputs are only ever taken when effects come faster than the strips can show them
+    while (effectBusy[nextEffect])
+        tight_loop_contents();
+    effectBusy[nextEffect] = true;
+    planar::encode(effect.data(), stripLanes, longestStrip, outputs[outputCount + nextEffect].data());
+    showOutput(outputCount + nextEffect);
+    nextEffect = (nextEffect + 1) % effectCount;
 }
 
 void showFreddy() {
     size_t ledIndex = strips[0].m_size + strips[1].m_size / 3 / 2 * 3 - 10 * 3;
     size_t ledIndex0 = ledIndex - 4 * 3;
     size_t ledIndex1 = ledIndex + 4 * 3;
-    for(size_t i = 0; i < totalDataCount; i++)
-        data[i] = 0u;
-    data[ledIndex0] = freddyBrightness;
-    data[ledIndex0 + 1] = freddyBrightness;
-    data[ledIndex0 + 2] = freddyBrightness;
-    data[ledIndex1] = freddyBrightness;
-    data[ledIndex1 + 1] = freddyBrightness;
-    data[ledIndex1 + 2] = freddyBrightness;
+    effect.fill(0u);
+    effect[ledIndex0] = freddyBrightness;
+    effect[ledIndex0 + 1] = freddyBrightness;
+    effect[ledIndex0 + 2] = freddyBrightness;
+    effect[ledIndex1] = freddyBrightness;
+    effect[ledIndex1 + 1] = freddyBrightness;
+    effect[ledIndex1 + 2] = freddyBrightness;
     showAll();
     freddyShown = true;
 }
 void hideFreddy() {
-    for(size_t i = 0; i < totalDataCount; i++)
-        data[i] = 0u;
+    effect.fill(0u);
     showAll();
     freddyShown = false;
 }
@@ -108,13 +354,11 @@ void setPower(uint8_t value) {
     powered = value > 0;
     gpio_put(relayPin, powered);
     if (!powered) {
-        for(size_t i = 0; i < totalDataCount; i++)
-            data[i] = 0u;
+        effect.fill(0u);
         showAll();
         // idk
         sleep_ms(10u);
-        for(size_t i = 0; i < totalDataCount; i++)
-            data[i] = 0u;
+        effect.fill(0u);
         showAll();
     }
     audio::stop();
@@ -122,76 +366,435 @@ void setPower(uint8_t value) {
     gpio_put(speakerPowerPin, freddy);
     if (freddy) {
         sleep_ms(100u);
-        if (freddyVorbis) {
-            stb_vorbis_close(freddyVorbis);
-            freddyVorbis = nullptr;
-        }
-        int err;
-        freddyVorbis = stb_vorbis_open_memory(musicbox, sizeof(musicbox), &err, nullptr);
+        freddySong = adpcm::Decoder(musicbox, musicboxSamples);
         showFreddy();
     }
 }
 
+void handleCore1(uint32_t message) {
+    uint32_t value = message & 0xffffff;
+    switch (static_cast<CoreCommand>(message >> 24)) {
+        case CoreCommand::Show: showOutput(value);
+            break;
+        case CoreCommand::ShowAt: showOutputAt(value, multicore_fifo_pop_blocking());
+            break;
+        case CoreCommand::Power: setPower(value);
+            break;
+        case CoreCommand::Idle:
+            if (!freddy)
+                setPower(0);
+            break;
+    }
+}
+
+// sleeping without leaving core 1's frames waiting
+void waitForCore1(absolute_time_t until) {
+    while (!time_reached(until)) {
+        if (multicore_fifo_rvalid())
+            handleCore1(multicore_fifo_pop_blocking());
+        else
+            tight_loop_contents();
+    }
+}
+
+// --- core 1 ---
+
+// transposes a finished frame into an output for core 0, usb keeps coming in while they're all still in use
+uint32_t encodeOutput(const uint8_t* frame) {
+    while (!multicore_fifo_rvalid())
+        usbPoll();
+    uint32_t output = multicore_fifo_pop_blocking();
+    planar::encode(frame, stripLanes, longestStrip, outputs[output].data());
+    if (frame != shown.data())
+        memcpy(shown.data(), frame, totalDataCount);
+    return output;
+}
+
+void present(const uint8_t* frame) {
+    multicore_fifo_push_blocking(coreMessage(CoreCommand::Show, encodeOutput(frame)));
+}
+
+// set while a timed message is being read, whatever it carries waits for then
+bool presentTimed = false;
+uint32_t presentDueUs = 0;
+
+// a whole new frame from the host is in data
+void presentReceived() {
+    absolute_time_t now = get_absolute_time();
+    int64_t since = absolute_time_diff_us(lastReceived, now);
+    lastReceived = now;
+    if (since >= 0 && since < maxFadeUs)
+        frameIntervalUs = (frameIntervalUs * 3 + static_cast<uint32_t>(since)) / 4;
+    if (presentTimed) {
+        fading = false;
+        multicore_fifo_push_blocking(coreMessage(CoreCommand::ShowAt, encodeOutput(data.data())));
+        multicore_fifo_push_blocking(presentDueUs);
+        return;
+    }
+    if (interpolation.curve == blend::Curve::None) {
+        present(data.data());
+        return;
+    }
+    // from wherever the last fade got to, so a frame that comes early doesn't jump
+    fadeFrom = shown;
+    fadeStart = now;
+    nextFade = now;
+    fading = true;
+}
+
 uint8_t readNext() {
+    if (frameCursor)
+        return frameCursor < frameEnd ? *frameCursor++ : 0;
     uint8_t b;
     while (!usbTryRead(b)) { }
     return b;
 }
 
+// false if it isn't all there by deadline, whatever did come is used up anyway
+bool readUsb(uint8_t* current, size_t remaining, absolute_time_t deadline) {
+    while (remaining > 0) {
+        if (rxHead == rxTail) {
+            if (time_reached(deadline))
+                return false;
+            // nothing queued, packets go straight where they belong instead
+            tud_task();
+            uint32_t count = tud_cdc_read(current, remaining);
+            current += count;
+            remaining -= count;
+            continue;
+        }
+        size_t index = rxHead % rxQueueSize;
+        size_t count = std::min({ remaining, rxTail - rxHead, rxQueueSize - index });
+        memcpy(current, &rxQueue[index], count);
+        rxHead += count;
+        current += count;
+        remaining -= count;
+    }
+    return true;
+}
+
+void readInto(uint8_t* current, size_t remaining) {
+    if (frameCursor) {
+        size_t count = std::min<size_t>(remaining, frameEnd - frameCursor);
+        memcpy(current, frameCursor, count);
+        memset(current + count, 0, remaining - count);
+        frameCursor += count;
+        return;
+    }
+    readUsb(current, remaining, at_the_end_of_time);
+}
+
+// what the decoding in protocol.hpp reads from
+struct Source {
+    uint8_t next() { return readNext(); }
+    void into(uint8_t* current, size_t remaining) { readInto(current, remaining); }
+} source;
+
 void readPower() {
-    setPower(readNext());
+    uint8_t value = readNext();
+    if (value == 0) {
+        data.fill(0u);
+        shown.fill(0u);
+        fading = false;
+        deviceEffect = effects::Params();
+    }
+    multicore_fifo_push_blocking(coreMessage(CoreCommand::Power, value));
 }
 
 void readData() {
-    size_t currStart = 0;
-    for (const auto& strip : strips) {
-        dma_channel_wait_for_finish_blocking(strip.m_dma);
+    readInto(data.data(), totalDataCount);
+    presentReceived();
+}
+
+void readEffect() {
+    uint8_t params[effects::paramsSize];
+    readInto(params, effects::paramsSize);
+    deviceEffect = effects::parse(params);
+    deviceEffectStartMs = to_ms_since_boot(get_absolute_time());
+}
+
+void readInterpolate() {
+    uint8_t params[blend::paramsSize];
+    readInto(params, blend::paramsSize);
+    interpolation = blend::parse(params);
+    // whatever fade was going finishes right away
+    if (fading)
+        present(data.data());
+    fading = false;
+}
+
+// one dma channel fills both blocks, then a control channel writes its start address back and triggers it again,
+// so it never writes anywhere else and never runs out. core 1 only looks at where it's writing, no interrupts
+void startMic() {
+    adc_init();
+    adc_gpio_init(micPin);
+    adc_select_input(micPin - 26);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(48000000.f / spectrum::sampleRate - 1.f);
+    micDma = dma_claim_unused_channel(true);
+    micControlDma = dma_claim_unused_channel(true);
+
+    dma_channel_config c = dma_channel_get_default_config(micDma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, DREQ_ADC);
+    channel_config_set_chain_to(&c, micControlDma);
+    dma_channel_configure(micDma, &c, micSamples.data(), &adc_hw->fifo, micSamples.size(), false);
+
+    dma_channel_config control = dma_channel_get_default_config(micControlDma);
+    channel_config_set_transfer_data_size(&control, DMA_SIZE_32);
+    channel_config_set_read_increment(&control, false);
+    channel_config_set_write_increment(&control, false);
+    dma_channel_configure(micControlDma, &control, &dma_hw->ch[micDma].al2_write_addr_trig, &micStart, 1, false);
+
+    // waits on the adc's dreq, which only comes once the spectrum turns it on
+    dma_channel_start(micDma);
+}
+
+void pollMic() {
+    // the adc only runs for the spectrum, the dma just waits in between
+    bool wanted = deviceEffect.effect == effects::Effect::Spectrum;
+    if (wanted != micRunning) {
+        micRunning = wanted;
+        adc_run(wanted);
+        if (!wanted)
+            adc_fifo_drain();
     }
-    for (const auto& strip : strips) {
-        auto* current = &data[currStart];
-        int remaining = strip.m_size;
-        int res;
-        do {
-            res = stdio_usb.in_chars(reinterpret_cast<char*>(current), remaining);
-            if (res < 0)
-                continue;
-            remaining -= res;
-            current += res;
-        } while(remaining > 0);
-        dma_channel_set_read_addr(strip.m_dma, &data[currStart], true);
-        currStart += strip.m_size;
+    if (!micRunning)
+        return;
+    // right at the end of the second block it points just past it for a moment, that's the first one again
+    uintptr_t written = dma_channel_hw_addr(micDma)->write_addr - reinterpret_cast<uintptr_t>(micSamples.data());
+    uint32_t filling = (written / (spectrum::fftSize * sizeof(uint16_t))) & 1;
+    if (filling == micFilling)
+        return;
+    // the other block just filled up, it has a block's worth of time before the dma's back
+    micFilling = filling;
+    int16_t samples[spectrum::fftSize];
+    spectrum::fromAdc(&micSamples[(1 - filling) * spectrum::fftSize], samples);
+    analyzer.process(samples);
+}
+
+// never waits for an output, usb comes first
+void drawEffect() {
+    if (deviceEffect.effect == effects::Effect::None || !multicore_fifo_rvalid())
+        return;
+    if (deviceEffect.effect == effects::Effect::Spectrum)
+        spectrum::render(analyzer, deviceEffect, ledCounts.data(), stripCount, data.data());
+    else
+        effects::render(deviceEffect, to_ms_since_boot(get_absolute_time()) - deviceEffectStartMs,
+            ledCounts.data(), stripCount, data.data());
+    fading = false;
+    present(data.data());
+}
+
+// the next step of the fade once an output's free and the rate allows, never waits either
+void drawFade() {
+    if (!fading || !multicore_fifo_rvalid() || !time_reached(nextFade))
+        return;
+    absolute_time_t now = get_absolute_time();
+    uint64_t elapsed = absolute_time_diff_us(fadeStart, now);
+    uint16_t progress = elapsed >= frameIntervalUs ? 256 : static_cast<uint16_t>(elapsed * 256 / frameIntervalUs);
+    blend::mix(fadeFrom.data(), data.data(), shown.data(), totalDataCount, blend::shape(interpolation.curve, progress),
+        interpolation.linearLight);
+    present(shown.data());
+    fading = progress < 256;
+    if (interpolation.rate > 0)
+        nextFade = delayed_by_us(now, 1000000 / interpolation.rate);
+}
+
+void readSpans() {
+    protocol::readSpans(source, data.data(), totalDataCount);
+    presentReceived();
+}
+
+void readCompressed() {
+    protocol::readCompressed(source, data.data(), totalDataCount, palette.data());
+    presentReceived();
+}
+
+void readTimed() {
+    presentDueUs = protocol::next32(source);
+    presentTimed = true;
+    switch (static_cast<DataType>(readNext())) {
+        case DataType::Data: readData();
+            break;
+        case DataType::Spans: readSpans();
+            break;
+        case DataType::Compressed: readCompressed();
+            break;
+        default:
+            break;
     }
+    presentTimed = false;
+}
+
+void readCredits() {
+    // a new host, whatever sequence the last one was at doesn't matter anymore
+    frameSequence.known = false;
+    usbWrite(static_cast<uint8_t>(ReplyType::Credits));
+    usbWrite(0x80 | frameCredits);
+}
+
+// every pong carries the time it went out so the host can work out our clock, the round trip tells it how close
+// that is. late and early frames tag along whenever there are new ones
+uint32_t reportedLate = 0;
+uint32_t reportedEarly = 0;
+void writePong() {
+    uint32_t late = std::min(lateFrames - reportedLate, protocol::maxReplyCount);
+    uint32_t early = std::min(earlyFrames - reportedEarly, protocol::maxReplyCount);
+    reportedLate += late;
+    reportedEarly += early;
+    uint8_t reply[protocol::maxPongSize];
+    usbWrite(reply, protocol::writePong(reply, time_us_32(), late, early));
 }
 
 absolute_time_t lastPing;
 void readPing() {
-    usbWrite(0); // pong hehe
+    writePong(); // hehe
     lastPing = get_absolute_time();
 }
 
-int main() {
-    stdio_init_all();
+void reportDropped(uint8_t count) {
+    usbWrite(static_cast<uint8_t>(ReplyType::Errors));
+    usbWrite(0x80 | std::min<uint8_t>(count, 0x7f));
+}
+
+void readFramed() {
+    // while hunting the marker might just be a byte out of some payload, only real frames count as errors
+    bool reject = !hunting;
+    hunting = false;
+
+    absolute_time_t deadline = make_timeout_time_us(frameTimeoutUs);
+    uint8_t header[protocol::frameHeaderSize];
+    bool valid = readUsb(header, protocol::frameHeaderSize, deadline);
+    size_t size = header[0] | (header[1] << 8);
+    uint8_t sequence = header[2];
+    valid = valid && size > 0 && size <= frame.size();
+    if (valid) {
+        uint8_t check[protocol::frameCrcSize];
+        valid = readUsb(frame.data(), size, deadline) && readUsb(check, protocol::frameCrcSize, deadline) &&
+            protocol::frameValid(header, frame.data(), size, check);
+    }
+    if (!valid) {
+        hunting = true;
+        if (reject) {
+            frameSequence.skip();
+            reportDropped(1);
+        }
+        return;
+    }
+
+    if (uint8_t missed = frameSequence.received(sequence))
+        reportDropped(missed);
+    // every good frame gets a pong, so it keeps the host's effect alive just like a ping
+    lastPing = get_absolute_time();
+
+    frameCursor = &frame[1];
+    frameEnd = &frame[size];
+    switch (static_cast<DataType>(frame[0])) {
+        case DataType::Power: readPower();
+            break;
+        case DataType::Data: readData();
+            break;
+        case DataType::Spans: readSpans();
+            break;
+        case DataType::Compressed: readCompressed();
+            break;
+        case DataType::Effect: readEffect();
+            break;
+        case DataType::Interpolate: readInterpolate();
+            break;
+        case DataType::Timed: readTimed();
+            break;
+        default:
+            break;
+    }
+    frameCursor = nullptr;
+    writePong();
+}
+
+void core1Main() {
+    // usb's interrupts end up on whichever core sets it up
+    tusb_init();
+    startMic();
+
+    while (true) {
+        uint8_t x;
+        if (!usbTryRead(x)) {
+            // the rest of a broken frame isn't coming, the host moved on
+            if (hunting && absolute_time_diff_us(lastByte, get_absolute_time()) > huntingTimeoutUs)
+                hunting = false;
+            pollMic();
+            drawEffect();
+            drawFade();
+            // no data for more than 5 seconds, the host still has to ping to keep an effect running
+            if (absolute_time_diff_us(lastPing, get_absolute_time()) < 5000000)
+                continue;
+            lastPing = at_the_end_of_time;
+            data.fill(0u);
+            shown.fill(0u);
+            fading = false;
+            deviceEffect = effects::Params();
+            multicore_fifo_push_blocking(coreMessage(CoreCommand::Idle, 0));
+            continue;
+        }
+        lastByte = get_absolute_time();
+        if (hunting && static_cast<DataType>(x) != DataType::Framed)
+            continue;
+        switch (static_cast<DataType>(x)) {
+            case DataType::Power: readPower();
+                break;
+            case DataType::Data: readData();
+                break;
+            case DataType::Ping: readPing();
+                break;
+            case DataType::Spans: readSpans();
+                break;
+            case DataType::Compressed: readCompressed();
+                break;
+            case DataType::Credits: readCredits();
+                break;
+            case DataType::Effect: readEffect();
+                break;
+            case DataType::Interpolate: readInterpolate();
+                break;
+            case DataType::Timed: readTimed();
+                break;
+            case DataType::Framed: readFramed();
+                break;
+        }
+    }
+}
 
+int main() {
     // relay
     gpio_init(relayPin);
     gpio_set_dir(relayPin, GPIO_OUT);
 
-    for (auto& strip : strips) {
-        uint offset = pio_add_program(strip.m_pio, &ws2812_program);
-        ws2812_program_init(strip.m_pio, strip.m_sm, offset, strip.m_pin);
-        strip.m_dma = dma_claim_unused_channel(true);
-        dma_channel_config c = dma_channel_get_default_config(strip.m_dma);
-        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
-        channel_config_set_read_increment(&c, true);
-        channel_config_set_write_increment(&c, false);
-        channel_config_set_dreq(&c, pio_get_dreq(strip.m_pio, strip.m_sm, true));
-        dma_channel_configure(strip.m_dma, &c,
-            &strip.m_pio->txf[strip.m_sm],
-            nullptr,
-            strip.m_size,
-            false
-        );
-    }
+    // every strip in one transfer
+    uint offset = pio_add_program(stripsPio, &ws2812_parallel_program);
+    ws2812_parallel_program_init(stripsPio, stripsSm, offset, stripsPinBase, stripsPinCount);
+    stripsDma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(stripsDma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(stripsPio, stripsSm, true));
+    dma_channel_configure(stripsDma, &c,
+        &stripsPio->txf[stripsSm],
+        nullptr,
+        planeWords,
+        false
+    );
+    // done and latched are both interrupts, nothing ever waits on the strips
+    dma_channel_set_irq0_enabled(stripsDma, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, stripsDmaDone);
+    irq_set_enabled(DMA_IRQ_0, true);
+    latchAlarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(latchAlarm, latchDone);
+    dueAlarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(dueAlarm, dueDone);
 
     // reset leds
     setPower(0);
@@ -209,7 +812,11 @@ int main() {
     // freddy speaker
     gpio_init(speakerPowerPin);
     gpio_set_dir(speakerPowerPin, GPIO_OUT);
-    audio::init(speakerDataPin, 22050);
+    audio::init(speakerDataPin, musicboxRate);
+
+    multicore_launch_core1(core1Main);
+    for (uint32_t i = 0; i < outputCount; i++)
+        multicore_fifo_push_blocking(i);
 
     int waitTime = 0;
     bool played = true;
@@ -217,51 +824,31 @@ int main() {
         // freddy fazbear mode har har har har har
         if (freddy) {
             // run for roughly 30 seconds
-            if (rand() % (30 * 100) == 0 || !freddyVorbis) {
+            if (rand() % (30 * 100) == 0 || freddySong.done()) {
                 hideFreddy();
 
                 audio::stop();
                 gpio_put(speakerPowerPin, false);
-                if (freddyVorbis) {
-                    stb_vorbis_close(freddyVorbis);
-                    freddyVorbis = nullptr;
-                }
+                freddySong = adpcm::Decoder();
 
                 // the random flickering at the end
                 for (int j = 0; j < 12; j++) {
-                    sleep_ms(33u);
+                    waitForCore1(make_timeout_time_ms(33));
                     int show = rand() % 2;
-                    for (size_t i = 0; i < totalDataCount; i++)
-                        data[i] = freddyBrightness * show;
+                    effect.fill(freddyBrightness * show);
                     showAll();
                 }
-                sleep_ms(33u);
+                waitForCore1(make_timeout_time_ms(33));
                 hideFreddy();
 
                 freddy = false;
                 gpio_put(relayPin, powered);
             }
 
-            if (played && freddyVorbis) {
-                float pcm[AUDIO_BUFFER_SIZE];
-                int n;
-                n = stb_vorbis_get_samples_float_interleaved(freddyVorbis, 1, pcm, AUDIO_BUFFER_SIZE);
-                if (n == 0) {
-                    stb_vorbis_close(freddyVorbis);
-                    freddyVorbis = nullptr;
-                }
-                else {
-                    uint8_t samples[AUDIO_BUFFER_SIZE];
-                    for (int i = 0; i < n; i++) {
-                        float s = (pcm[i] + 1.f) * 0.5f * 255.f;
-                        if (s > 255.f)
-                            s = 255.f;
-                        if (s < 0.f)
-                            s = 0.f;
-                        samples[i] = static_cast<uint8_t>(s);
-                    }
-                    audio::addSamples(samples, AUDIO_BUFFER_SIZE);
-                }
+            if (played && !freddySong.done()) {
+                uint8_t samples[AUDIO_BUFFER_SIZE];
+                size_t n = freddySong.decode(samples, AUDIO_BUFFER_SIZE);
+                audio::addSamples(samples, n);
             }
             played = audio::step();
 
@@ -274,38 +861,20 @@ int main() {
             }
 
             waitTime -= 10;
-            sleep_ms(10u);
+            waitForCore1(make_timeout_time_ms(10));
         }
         //else if (!powered) {
         //    // freddy roughly every 60 days
         //    if (rand() % (60 * 24 * 60 * 60 * 100) == 0) {
         //        freddy = true;
         //        gpio_put(relayPin, true);
-        //        int err;
-        //        freddyVorbis = stb_vorbis_open_memory(musicbox, sizeof(musicbox), &err, nullptr);
+        //        freddySong = adpcm::Decoder(musicbox, musicboxSamples);
         //        gpio_put(speakerPowerPin, true);
         //    }
         //    sleep_ms(10u);
         //}
 
-        uint8_t x;
-        if (!usbTryRead(x)) {
-            if (freddy)
-                continue;
-            // no data for more than 5 seconds
-            if (absolute_time_diff_us(get_absolute_time(), lastPing) < 5000000)
-                continue;
-            lastPing = at_the_end_of_time;
-            setPower(0);
-            continue;
-        }
-        switch (static_cast<DataType>(x)) {
-            case DataType::Power: readPower();
-                break;
-            case DataType::Data: readData();
-                break;
-            case DataType::Ping: readPing();
-                break;
-        }
+        if (!freddy)
+            handleCore1(multicore_fifo_pop_blocking());
     }
 }
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// all strips go out of one state machine that drives up to 8 consecutive pins at once, so every bit time is
+// a byte with bit n for the strip on pin base + n. the state machine takes them low byte first out of each word
+namespace planar {
+    constexpr size_t maxLanes = 8;
+
+    // where a lane's grb bytes are in the frame, empty for pins in between that have no strip
+    struct Lane {
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    // rows are the lanes' bytes from lane 7 down to lane 0, out comes one word per 4 bit times
+    // (msb of the bytes first). the usual three rounds of masked swaps on both halves of an 8x8 bit matrix
+    inline void transpose(const uint8_t (&rows)[maxLanes], uint32_t* out) {
+        uint32_t x = (uint32_t(rows[0]) << 24) | (uint32_t(rows[1]) << 16) | (uint32_t(rows[2]) << 8) | rows[3];
+        uint32_t y = (uint32_t(rows[4]) << 24) | (uint32_t(rows[5]) << 16) | (uint32_t(rows[6]) << 8) | rows[7];
+        uint32_t t;
+        t = (x ^ (x >> 7)) & 0x00aa00aa;
+        x = x ^ t ^ (t << 7);
+        t = (y ^ (y >> 7)) & 0x00aa00aa;
+        y = y ^ t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000cccc;
+        x = x ^ t ^ (t << 14);
+        t = (y ^ (y >> 14)) & 0x0000cccc;
+        y = y ^ t ^ (t << 14);
+        t = (x & 0xf0f0f0f0) | ((y >> 4) & 0x0f0f0f0f);
+        y = ((x << 4) & 0xf0f0f0f0) | (y & 0x0f0f0f0f);
+        x = t;
+        // the first bit time ended up in the high byte
+        out[0] = __builtin_bswap32(x);
+        out[1] = __builtin_bswap32(y);
+    }
+
+    // the whole frame as bit times for the longest lane, the shorter ones get padded with zeros
+    // which just fall off the end of their strips. out needs wordsFor(longest) words
+    inline void encode(const uint8_t* data, const std::array<Lane, maxLanes>& lanes, size_t longest, uint32_t* out) {
+        uint8_t rows[maxLanes];
+        for (size_t i = 0; i < longest; i++) {
+            for (size_t lane = 0; lane < maxLanes; lane++)
+                rows[maxLanes - 1 - lane] = i < lanes[lane].size ? data[lanes[lane].offset + i] : 0;
+            transpose(rows, out);
+            out += 2;
+        }
+    }
+
+    // 8 bit times per byte of the longest lane, 4 of them per word
+    constexpr size_t wordsFor(size_t longest) {
+        return longest * 2;
+    }
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "crc.hpp"
+
+// the serial protocol's decoding, shared with the emulator (see host/) so the two can't drift apart. everything
+// reads through a source with uint8_t next() and void into(uint8_t*, size_t), which is usb or a checked frame here
+// and the emulated link there
+namespace protocol {
+    enum class DataType : uint8_t {
+        Power,
+        Data,
+        Ping,
+        Spans,
+        Compressed,
+        Credits,
+        // effects::paramsSize bytes of effects::Params, drawn right here at whatever rate the strips manage until
+        // it's set back to none. 6 is the nano's indexed frames
+        Effect = 7,
+        // blend::paramsSize bytes of blend::Params, frames from the host get faded into from then on
+        Interpolate = 8,
+        // u32 due time in device microseconds (see ReplyType::Clock), then a data, spans or compressed message that
+        // goes to the strips at that time instead of right away. those are never faded
+        Timed = 9,
+        // u16 length, u8 sequence, then a message of that length (its type and payload) and the crc-16 of all of
+        // it, answered with a pong on its own
+        Framed = 0xa5
+    };
+
+    enum class ReplyType : uint8_t {
+        Pong = 0,
+        Ready = 1,
+        Credits = 0x40,
+        // how many framed messages were rejected or never arrived, none of them get a pong
+        Errors = 0x41,
+        // right behind every pong, the device's microsecond clock as a u32 in 7 bit groups low first
+        Clock = 0x42,
+        // timed frames that came too late and too early since the last one, those went out right away
+        Timing = 0x43
+    };
+
+    // type and due time in front of a timed message
+    constexpr size_t timedPrefix = 1 + 4;
+    constexpr size_t frameHeaderSize = 3;
+    constexpr size_t frameCrcSize = 2;
+
+    // the biggest framed message is a whole raw frame behind a timed prefix, the 2 are slack for spans' count
+    constexpr size_t maxFrameSize(size_t dataSize) {
+        return timedPrefix + 1 + 2 + dataSize;
+    }
+
+    // counts in replies are 7 bits
+    constexpr uint32_t maxReplyCount = 0x7f;
+    // pong, clock and timing
+    constexpr size_t maxPongSize = 1 + 1 + 5 + 3;
+
+    // late and early have to be at most maxReplyCount, they're left out when both are 0
+    inline size_t writePong(uint8_t* reply, uint32_t now, uint32_t late, uint32_t early) {
+        size_t size = 0;
+        reply[size++] = static_cast<uint8_t>(ReplyType::Pong);
+        reply[size++] = static_cast<uint8_t>(ReplyType::Clock);
+        for (uint32_t i = 0; i < 5; i++, now >>= 7)
+            reply[size++] = static_cast<uint8_t>(0x80 | (now & 0x7f));
+        if (late > 0 || early > 0) {
+            reply[size++] = static_cast<uint8_t>(ReplyType::Timing);
+            reply[size++] = static_cast<uint8_t>(0x80 | late);
+            reply[size++] = static_cast<uint8_t>(0x80 | early);
+        }
+        return size;
+    }
+
+    // whether a framed message's header, payload and crc belong together
+    inline bool frameValid(const uint8_t* header, const uint8_t* payload, size_t size, const uint8_t* check) {
+        uint16_t crc = crc::update(crc::update(crc::init, header, frameHeaderSize), payload, size);
+        return crc == (check[0] | (check[1] << 8));
+    }
+
+    // framed messages the sequence skipped since the last good one, those got lost entirely, marker and all
+    struct Sequence {
+        uint8_t next = 0;
+        bool known = false;
+
+        // a rejected one still used up its number
+        void skip() {
+            next++;
+        }
+
+        uint8_t received(uint8_t sequence) {
+            uint8_t missed = sequence - next;
+            bool counts = known && missed > 0 && missed < 0x80;
+            known = true;
+            next = sequence + 1;
+            return counts ? missed : 0;
+        }
+    };
+
+    template <typename Source>
+    uint16_t next16(Source& in) {
+        uint16_t lo = in.next();
+        return lo | (in.next() << 8);
+    }
+
+    template <typename Source>
+    uint32_t next32(Source& in) {
+        uint32_t lo = next16(in);
+        return lo | (static_cast<uint32_t>(next16(in)) << 16);
+    }
+
+    // u16 count, then u16 led offset, u16 led count and the grb bytes for each. whatever's past the end is skipped
+    template <typename Source>
+    void readSpans(Source& in, uint8_t* data, size_t dataSize) {
+        uint16_t count = next16(in);
+        for (uint16_t i = 0; i < count; i++) {
+            size_t start = next16(in) * 3;
+            size_t size = next16(in) * 3;
+            size_t inside = start < dataSize ? std::min(size, dataSize - start) : 0;
+            if (inside > 0)
+                in.into(&data[start], inside);
+            for (size_t j = inside; j < size; j++)
+                in.next();
+        }
+    }
+
+    // u16 palette size and the palette's grb colors, then runs until the frame's full. a run header has the count
+    // - 1 in the low 7 bits and the high bit set for one pixel repeated, otherwise that many pixels follow. pixels
+    // are a palette index when there's a palette and grb bytes when there isn't
+    template <typename Source>
+    void readCompressed(Source& in, uint8_t* data, size_t dataSize, uint8_t* palette) {
+        size_t sent = next16(in) * 3;
+        size_t paletteSize = std::min<size_t>(sent, 256 * 3);
+        if (paletteSize > 0)
+            in.into(palette, paletteSize);
+        // an index can't reach past 256 colors, but whatever else was sent still has to go or the runs would start
+        // in the middle of the palette
+        for (size_t j = paletteSize; j < sent; j++)
+            in.next();
+        uint8_t pixel[3];
+        auto readPixel = [&]() {
+            if (paletteSize == 0) {
+                in.into(pixel, 3);
+                return;
+            }
+            memcpy(pixel, &palette[in.next() * 3], 3);
+        };
+        size_t i = 0;
+        while (i < dataSize) {
+            uint8_t op = in.next();
+            size_t count = (op & 0x7f) + 1;
+            bool run = op & 0x80;
+            if (run)
+                readPixel();
+            for (; count > 0; count--, i += 3) {
+                if (!run)
+                    readPixel();
+                if (i >= dataSize)
+                    continue;
+                memcpy(&data[i], pixel, 3);
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// fixed size single producer single consumer byte ring, the two sides can be on different cores or one of them
+// in an irq. head and tail only ever count up and wrap through the mask, so full and empty never look alike
+template<size_t Size>
+class Ring {
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "ring size has to be a power of two");
+
+public:
+    // producer side, copies as much as fits and returns how much that was
+    size_t write(const uint8_t* data, size_t count) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        count = std::min(count, Size - (head - tail));
+        size_t index = head & (Size - 1);
+        size_t first = std::min(count, Size - index);
+        memcpy(&m_data[index], data, first);
+        memcpy(&m_data[0], data + first, count - first);
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer side, copies out as much as there is and returns how much that was
+    size_t read(uint8_t* data, size_t count) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        count = std::min(count, head - tail);
+        size_t index = tail & (Size - 1);
+        size_t first = std::min(count, Size - index);
+        memcpy(data, &m_data[index], first);
+        memcpy(data + first, &m_data[0], count - first);
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer side, drops everything that's in there right now
+    void clear() {
+        m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // exact from either side for its own end, the other one might have moved on already
+    size_t size() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() {
+        return Size;
+    }
+
+private:
+    std::atomic<size_t> m_head = 0;
+    std::atomic<size_t> m_tail = 0;
+    uint8_t m_data[Size];
+};
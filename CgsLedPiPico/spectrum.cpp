@@ -0,0 +1,166 @@
+#include "spectrum.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+    using spectrum::Complex;
+    using spectrum::fftSize;
+
+    // e^(-2 pi i k / fftSize) in 1.15, worked out once at startup
+    const std::array<Complex, fftSize> twiddles = [] {
+        std::array<Complex, fftSize> res;
+        for (size_t k = 0; k < fftSize; k++) {
+            double angle = -2.0 * 3.14159265358979323846 * static_cast<double>(k) / fftSize;
+            res[k] = { static_cast<int32_t>(std::lround(std::cos(angle) * 32767.0)),
+                static_cast<int32_t>(std::lround(std::sin(angle) * 32767.0)) };
+        }
+        return res;
+    }();
+
+    // where each output of the in place radix-4 ends up, base 4 digits reversed
+    const std::array<uint8_t, fftSize> digitReversed = [] {
+        std::array<uint8_t, fftSize> res;
+        for (size_t i = 0; i < fftSize; i++) {
+            size_t reversed = 0;
+            for (size_t x = i, n = fftSize; n > 1; n /= 4, x /= 4)
+                reversed = reversed * 4 + x % 4;
+            res[i] = static_cast<uint8_t>(reversed);
+        }
+        return res;
+    }();
+
+    Complex multiply(Complex a, Complex b) {
+        return { (a.re * b.re - a.im * b.im) >> 15, (a.re * b.im + a.im * b.re) >> 15 };
+    }
+
+    uint32_t squareRoot(uint32_t x) {
+        uint32_t res = 0;
+        uint32_t bit = 1u << 30;
+        while (bit > x)
+            bit >>= 2;
+        while (bit != 0) {
+            if (x >= res + bit) {
+                x -= res + bit;
+                res = (res >> 1) + bit;
+            }
+            else {
+                res >>= 1;
+            }
+            bit >>= 2;
+        }
+        return res;
+    }
+}
+
+void spectrum::fft(std::array<Complex, fftSize>& x) {
+    // decimation in frequency, every butterfly divides by 4 so after all 4 stages it's the 1/fftSize
+    for (size_t span = fftSize; span > 1; span /= 4) {
+        const size_t quarter = span / 4;
+        const size_t stride = fftSize / span;
+        for (size_t j = 0; j < quarter; j++) {
+            const Complex w1 = twiddles[j * stride];
+            const Complex w2 = twiddles[2 * j * stride];
+            const Complex w3 = twiddles[3 * j * stride];
+            for (size_t i = j; i < fftSize; i += span) {
+                const Complex a = x[i];
+                const Complex b = x[i + quarter];
+                const Complex c = x[i + 2 * quarter];
+                const Complex d = x[i + 3 * quarter];
+                const Complex ac = { a.re + c.re, a.im + c.im };
+                const Complex acDiff = { a.re - c.re, a.im - c.im };
+                const Complex bd = { b.re + d.re, b.im + d.im };
+                const Complex bdDiff = { b.re - d.re, b.im - d.im };
+                x[i] = { (ac.re + bd.re) >> 2, (ac.im + bd.im) >> 2 };
+                // -i (b - d) and +i (b - d)
+                x[i + quarter] = multiply({ (acDiff.re + bdDiff.im) >> 2, (acDiff.im - bdDiff.re) >> 2 }, w1);
+                x[i + 2 * quarter] = multiply({ (ac.re - bd.re) >> 2, (ac.im - bd.im) >> 2 }, w2);
+                x[i + 3 * quarter] = multiply({ (acDiff.re - bdDiff.im) >> 2, (acDiff.im + bdDiff.re) >> 2 }, w3);
+            }
+        }
+    }
+    for (size_t i = 0; i < fftSize; i++) {
+        size_t j = digitReversed[i];
+        if (i < j)
+            std::swap(x[i], x[j]);
+    }
+}
+
+void spectrum::fromAdc(const uint16_t* adc, int16_t* out) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < fftSize; i++)
+        sum += adc[i] & 0xfff;
+    int32_t mean = static_cast<int32_t>(sum / fftSize);
+    for (size_t i = 0; i < fftSize; i++) {
+        int32_t x = ((adc[i] & 0xfff) - mean) * 16;
+        out[i] = static_cast<int16_t>(x < -32768 ? -32768 : x > 32767 ? 32767 : x);
+    }
+}
+
+spectrum::Analyzer::Analyzer() {
+    for (size_t i = 0; i < fftSize; i++)
+        m_window[i] = static_cast<int16_t>(std::lround((0.54 - 0.46 * std::cos(2.0 * 3.14159265358979323846 * i / (fftSize - 1))) * 32767.0));
+}
+
+void spectrum::Analyzer::process(const int16_t* samples) {
+    for (size_t i = 0; i < fftSize; i++)
+        m_buffer[i] = { (samples[i] * m_window[i]) >> 15, 0 };
+    fft(m_buffer);
+    for (size_t i = 0; i < binCount; i++) {
+        const Complex& x = m_buffer[i];
+        m_bins[i] = static_cast<uint16_t>(squareRoot(static_cast<uint32_t>(x.re * x.re + x.im * x.im)));
+    }
+}
+
+uint8_t spectrum::level(const uint16_t* bins, size_t count, uint16_t position, uint16_t noiseCut) {
+    if (count == 0)
+        return 0;
+    // more leds for the low end, p², (p - 0.4) * 1.4 + 0.16 and p / 4, whichever's furthest along. all of it
+    // stays in 32 bits, the m0+ has no 64 bit multiply
+    const uint32_t p = position;
+    const int32_t a = static_cast<int32_t>((p * p) >> 16);
+    const int32_t b = (((static_cast<int32_t>(p) - 26214) * 45875) >> 15) + 10486;
+    const int32_t c = static_cast<int32_t>(p / 4);
+    // at most 0.16 times 127 bins
+    const uint32_t index16 = static_cast<uint32_t>(std::max(std::max(a, b), c)) * static_cast<uint32_t>(count - 1);
+    const size_t index = index16 >> 16;
+    const uint32_t frac = index16 & 0xffff;
+    const int32_t current = bins[index];
+    const int32_t next = index + 1 < count ? bins[index + 1] : current;
+    // smoothstep with 2 bits off the second factor so the product fits, then 0.15 so the step between bins does too
+    const uint32_t squared = (frac * frac) >> 16;
+    const uint32_t smooth = (squared * ((3 * 65536 - 2 * frac) >> 2)) >> 14;
+    const int32_t bin = current + (((next - current) * static_cast<int32_t>(smooth >> 1)) >> 15);
+
+    // ProcessBin's 0.6496 in 1.15, then the square root in 0.16
+    const uint32_t ratio = bin >= 21287 ? 65535 : static_cast<uint32_t>(bin) * 65536 / 21287;
+    const uint32_t x = squareRoot(ratio << 16);
+    const uint32_t quiet = x / 5;
+    // x is below 65536 so above the cut this never reaches 1
+    const uint32_t loud = x <= noiseCut ? 0 : ((x - noiseCut) << 16) / (65536 - noiseCut);
+    const uint32_t res = std::max(quiet, loud);
+    return static_cast<uint8_t>(res >= 65535 ? 255 : res >> 8);
+}
+
+void spectrum::render(const Analyzer& analyzer, const effects::Params& params, const size_t* ledCounts, size_t stripCount, uint8_t* grb) {
+    const size_t count = std::min<size_t>(params.scale, binCount);
+    for (size_t strip = 0; strip < stripCount; strip++) {
+        const size_t leds = ledCounts[strip];
+        const size_t half = (leds + 1) / 2;
+        for (size_t i = 0; i < half; i++) {
+            uint8_t value = level(analyzer.bins().data(), count, static_cast<uint16_t>(i * 65536 / half), params.size);
+            uint8_t color[3];
+            for (size_t j = 0; j < 3; j++) {
+                int32_t mixed = params.from[j] + (((params.to[j] - params.from[j]) * value) >> 8);
+                color[j] = static_cast<uint8_t>(mixed * value / 255);
+            }
+            for (size_t led : { i, leds - 1 - i }) {
+                grb[led * 3] = color[1];
+                grb[led * 3 + 1] = color[0];
+                grb[led * 3 + 2] = color[2];
+            }
+        }
+        grb += leds * 3;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "effects.hpp"
+
+// the service's fft mode without the pc, fixed point like effects.hpp and just as portable (see host/)
+namespace spectrum {
+    // 4^4 for the radix-4 fft. at 12kHz every bin is as wide as the service's 1024 points at 48kHz,
+    // so its 56 bins cover the same 0 to 2.6kHz
+    constexpr size_t fftSize = 256;
+    constexpr size_t binCount = fftSize / 2;
+    constexpr uint32_t sampleRate = 12000;
+
+    struct Complex {
+        int32_t re;
+        int32_t im;
+    };
+
+    // 1.15, in place and scaled by 1/fftSize like NAudio's forward transform so nothing can overflow
+    void fft(std::array<Complex, fftSize>& x);
+
+    // 12 bit adc samples to 1.15 around the block's own mean, whatever the mic's bias is
+    void fromAdc(const uint16_t* adc, int16_t* out);
+
+    class Analyzer {
+    public:
+        Analyzer();
+
+        // fftSize samples, hamming windowed like SampleAggregator.cs
+        void process(const int16_t* samples);
+        // 1.15 magnitudes of the latest block
+        const std::array<uint16_t, binCount>& bins() const { return m_bins; }
+
+    private:
+        std::array<int16_t, fftSize> m_window;
+        std::array<Complex, fftSize> m_buffer;
+        std::array<uint16_t, binCount> m_bins { };
+    };
+
+    // FftEffect.GetBin and ProcessBin, 0 to 255 for position along the strip in 0.16. noiseCut is 0.16 too
+    uint8_t level(const uint16_t* bins, size_t count, uint16_t position, uint16_t noiseCut);
+
+    // Effect::Spectrum, every strip mirrored from both ends like FftModeConfig's default. scale is how many bins
+    // (56 in the service), size the noise cut in 0.16 (0.25 there), from and to the quiet and loud colors
+    void render(const Analyzer& analyzer, const effects::Params& params, const size_t* ledCounts, size_t stripCount, uint8_t* grb);
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "adpcm.hpp"
+
+#define STB_VORBIS_MAX_CHANNELS 1
+#include "stb_vorbis.c"
+
+// decodes an ogg once on the host and writes it out as ima adpcm for the firmware to play from flash
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <in.ogg> <out.h> <name>\n", argv[0]);
+        return 2;
+    }
+
+    int channels = 0;
+    int rate = 0;
+    short* pcm = nullptr;
+    int samples = stb_vorbis_decode_filename(argv[1], &channels, &rate, &pcm);
+    if (samples <= 0) {
+        fprintf(stderr, "can't decode %s\n", argv[1]);
+        return 1;
+    }
+
+    // only the first channel, the speaker is mono anyway
+    std::vector<uint8_t> encoded((samples + 1) / 2);
+    adpcm::State state;
+    for (int i = 0; i < samples; i++) {
+        uint8_t nibble = state.encode(pcm[i * channels]);
+        encoded[i / 2] |= i & 1 ? nibble << 4 : nibble;
+    }
+    free(pcm);
+
+    FILE* out = fopen(argv[2], "w");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+    const char* name = argv[3];
+    const char* source = argv[1];
+    for (const char* c = argv[1]; *c; c++) {
+        if (*c == '/' || *c == '\\')
+            source = c + 1;
+    }
+    fprintf(out, "// generated from %s by tools/musicbox, ima adpcm\n#pragma once\n\n", source);
+    fprintf(out, "constexpr unsigned int %sRate = %d;\n", name, rate);
+    fprintf(out, "constexpr unsigned int %sSamples = %d;\n", name, samples);
+    fprintf(out, "const unsigned char %s[] = {", name);
+    for (size_t i = 0; i < encoded.size(); i++)
+        fprintf(out, "%s0x%02x,", i % 32 == 0 ? "\n    " : " ", encoded[i]);
+    fprintf(out, "\n};\n");
+    fclose(out);
+    printf("%s: %d samples at %d hz, %zu bytes\n", argv[2], samples, rate, encoded.size());
+    return 0;
+}
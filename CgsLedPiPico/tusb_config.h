@@ -0,0 +1,19 @@
+#pragma once
+
+// tinyusb straight from core 1 instead of going through pico_stdio_usb, just the one cdc interface
+
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+#define CFG_TUSB_OS OPT_OS_PICO
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+#define CFG_TUD_CDC 1
+#define CFG_TUD_MSC 0
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 0
+
+// a few packets, main.cpp's own receive queue is the real buffer
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 64
+#define CFG_TUD_CDC_EP_BUFSIZE 64
@@ -0,0 +1,81 @@
+#include <string.h>
+#include <algorithm>
+
+#include "pico/bootrom.h"
+#include "pico/unique_id.h"
+#include "tusb.h"
+
+// descriptors and callbacks tinyusb wants, the same ids and strings pico_stdio_usb used so the host sees the same board
+
+namespace {
+    enum : uint8_t {
+        cdcInterface,
+        cdcDataInterface,
+        interfaceCount
+    };
+    constexpr uint8_t notifyEndpoint = 0x81;
+    constexpr uint8_t outEndpoint = 0x02;
+    constexpr uint8_t inEndpoint = 0x82;
+    constexpr uint16_t configLength = TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN;
+
+    const tusb_desc_device_t deviceDescriptor = {
+        .bLength = sizeof(tusb_desc_device_t),
+        .bDescriptorType = TUSB_DESC_DEVICE,
+        .bcdUSB = 0x0200,
+        .bDeviceClass = TUSB_CLASS_MISC,
+        .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+        .bDeviceProtocol = MISC_PROTOCOL_IAD,
+        .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+        .idVendor = 0x2e8a,
+        .idProduct = 0x000a,
+        .bcdDevice = 0x0100,
+        .iManufacturer = 1,
+        .iProduct = 2,
+        .iSerialNumber = 3,
+        .bNumConfigurations = 1
+    };
+
+    const uint8_t configDescriptor[] = {
+        TUD_CONFIG_DESCRIPTOR(1, interfaceCount, 0, configLength, 0, 250),
+        TUD_CDC_DESCRIPTOR(cdcInterface, 4, notifyEndpoint, 8, outEndpoint, inEndpoint, 64)
+    };
+
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char* const strings[] = { "Raspberry Pi", "Pico", serial, "Board CDC" };
+    uint16_t stringDescriptor[1 + 32];
+}
+
+extern "C" const uint8_t* tud_descriptor_device_cb() {
+    return reinterpret_cast<const uint8_t*>(&deviceDescriptor);
+}
+
+extern "C" const uint8_t* tud_descriptor_configuration_cb(uint8_t index) {
+    return configDescriptor;
+}
+
+extern "C" const uint16_t* tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    size_t length;
+    if (index == 0) {
+        // english
+        stringDescriptor[1] = 0x0409;
+        length = 1;
+    }
+    else {
+        if (index > sizeof(strings) / sizeof(strings[0]))
+            return nullptr;
+        if (!serial[0])
+            pico_get_unique_board_id_string(serial, sizeof(serial));
+        const char* string = strings[index - 1];
+        length = std::min<size_t>(strlen(string), 32);
+        for (size_t i = 0; i < length; i++)
+            stringDescriptor[1 + i] = static_cast<uint8_t>(string[i]);
+    }
+    stringDescriptor[0] = static_cast<uint16_t>((TUSB_DESC_STRING << 8) | (2 * length + 2));
+    return stringDescriptor;
+}
+
+// opening the port at 1200 baud still drops it into the bootloader like stdio's cdc did
+extern "C" void tud_cdc_line_coding_cb(uint8_t itf, const cdc_line_coding_t* coding) {
+    if (coding->bit_rate == 1200)
+        reset_usb_boot(0, 0);
+}